@@ -0,0 +1,714 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Popup latency benchmark. Stands in for the Bluetooth agent on the bus of
+   DBUS_SYSTEM_BUS_ADDRESS, launches bt-syspopup once per request with the
+   request bundle on its command line, and times the popups a BT_BENCHMARK
+   build answers by itself:
+   - launch-to-visible, from the launch to the first frame drawn
+   - click-to-reply, from the button press to the reply at the agent
+   With -s, a soak run instead: one popup process answers all the requests,
+   mixed over every event type and handed to it over D-Bus. Its memory is
+   sampled once each request has settled, and the growth since the sample
+   before is put on the type of that request. The run fails when a type,
+   past its warm-up, has left the process with more objects, heap or RSS.
+   See bt-bench.sh for the private bus and the virtual X server. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <dbus/dbus-glib-lowlevel.h>
+
+#include "bt-syspopup.h"
+
+#define BT_BENCH_ROUNDS 20
+#define BT_BENCH_TIMEOUT 10	/* Seconds for one popup to be answered */
+#define BT_BENCH_SIGNAL_WAIT 1000	/* msec for a Response after exit */
+#define BT_BENCH_DEVICE "bt-bench"
+
+#define BT_BENCH_SETTLE 100	/* msec from the reply to the memory sample */
+#define BT_BENCH_WARMUP 20	/* First requests of a type, not accounted */
+/* Growth a type may leave over the whole soak run */
+#define BT_BENCH_OBJECT_SLACK 8
+#define BT_BENCH_HEAP_SLACK_KB 256
+#define BT_BENCH_RSS_SLACK_KB 1024
+
+/* Memory of the popup process, see GetMemorySample */
+struct bt_bench_sample {
+	gint64 objects;
+	gint64 heap_kb;
+	gint64 rss_kb;
+};
+
+/* Requests answered through a popup button. The bundles carry the keys
+   each event type requires. Not measured: passkey-display-request draws
+   nothing and sends no reply, and the "none" type of app-confirm-request
+   and bt-information goes to the ticker instead of a popup. */
+struct bt_bench_event {
+	const char *name;
+	const char *args[5];	/* Bundle keys and values, NULL ended */
+	GArray *visible;	/* usec */
+	GArray *reply;
+	int failed;
+	int soaked;		/* Requests of the soak run */
+	struct bt_bench_sample growth;	/* Summed past the warm-up */
+};
+
+static struct bt_bench_event bt_bench_events[] = {
+	{ "pin-request",
+	  { "device-name", BT_BENCH_DEVICE } },
+	{ "passkey-confirm-request",
+	  { "device-name", BT_BENCH_DEVICE, "passkey", BT_BENCH_CODE } },
+	{ "passkey-request",
+	  { "device-name", BT_BENCH_DEVICE } },
+	{ "authorize-request",
+	  { "device-name", BT_BENCH_DEVICE } },
+	{ "push-authorize-request",
+	  { "device-name", BT_BENCH_DEVICE, "file", "bt-bench.txt" } },
+	{ "confirm-overwrite-request",
+	  { "file", "bt-bench.txt" } },
+	{ "keyboard-passkey-request",
+	  { "device-name", BT_BENCH_DEVICE, "passkey", BT_BENCH_CODE } },
+	{ "exchange-request",
+	  { "device-name", BT_BENCH_DEVICE } },
+	/* Answered with the Response signal, not a method call */
+	{ "app-confirm-request",
+	  { "title", BT_BENCH_DEVICE, "type", "twobtn" } },
+	{ "bt-information",
+	  { "title", BT_BENCH_DEVICE, "type", "onebtn" } },
+};
+
+struct bt_bench {
+	GMainLoop *loop;
+	const char *popup;	/* bt-syspopup executable */
+	const char *only;	/* Event type to run, NULL for all */
+	int rounds;
+	int round;
+	int index;		/* Of bt_bench_events */
+	GPid pid;
+	gint64 launched;
+	gint64 replied;		/* First reply of the request at the agent */
+	gboolean exited;
+	guint timer;
+	gboolean done;
+	DBusConnection *conn;
+	int soak;		/* Requests of the soak run, 0 for latencies */
+	int sent;
+	struct bt_bench_sample last;	/* After the previous request */
+	gboolean sampled;
+	gboolean failed;
+};
+
+static void __bt_bench_next(struct bt_bench *bench);
+static void __bt_bench_finish(struct bt_bench *bench);
+static void __bt_bench_soak_next(struct bt_bench *bench);
+static gboolean __bt_bench_settle_cb(gpointer data);
+
+static void __bt_bench_replied(struct bt_bench *bench)
+{
+	if (bench->replied)
+		return;
+
+	bench->replied = g_get_monotonic_time();
+
+	/* The popup stays, sample it once it is done with the request */
+	if (bench->soak) {
+		if (bench->timer)
+			g_source_remove(bench->timer);
+		bench->timer = g_timeout_add(BT_BENCH_SETTLE,
+					     __bt_bench_settle_cb, bench);
+		return;
+	}
+
+	/* A signal may arrive after the popup has exited */
+	if (bench->exited) {
+		g_source_remove(bench->timer);
+		bench->timer = 0;
+		__bt_bench_finish(bench);
+	}
+}
+
+static DBusHandlerResult __bt_bench_agent_cb(DBusConnection *conn,
+					     DBusMessage *msg, void *data)
+{
+	struct bt_bench *bench = data;
+	DBusMessage *reply;
+	const char *member;
+
+	member = dbus_message_get_member(msg);
+	if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_METHOD_CALL ||
+	    member == NULL || strncmp(member, "Reply", strlen("Reply")))
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	__bt_bench_replied(bench);
+
+	/* The popup waits for this before it exits */
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return DBUS_HANDLER_RESULT_NEED_MEMORY;
+
+	dbus_connection_send(conn, reply, NULL);
+	dbus_message_unref(reply);
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static const DBusObjectPathVTable bt_bench_agent_vtable = {
+	.message_function = __bt_bench_agent_cb,
+};
+
+/* Answer of app-confirm-request and bt-information */
+static DBusHandlerResult __bt_bench_signal_cb(DBusConnection *conn,
+					      DBusMessage *msg, void *data)
+{
+	if (dbus_message_is_signal(msg, BT_SYS_POPUP_INTERFACE,
+				   BT_SYS_POPUP_METHOD_RESPONSE))
+		__bt_bench_replied(data);
+
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+/* Answer on the agent and OBEX agent paths the popup replies to */
+static int __bt_bench_init_agent(struct bt_bench *bench)
+{
+	DBusGConnection *gconn;
+	DBusConnection *conn;
+	DBusError err;
+	int ret;
+
+	gconn = dbus_g_bus_get(DBUS_BUS_SYSTEM, NULL);
+	if (gconn == NULL) {
+		fprintf(stderr, "No bus, is DBUS_SYSTEM_BUS_ADDRESS set?\n");
+		return -1;
+	}
+
+	conn = dbus_g_connection_get_connection(gconn);
+	bench->conn = conn;
+
+	dbus_error_init(&err);
+	ret = dbus_bus_request_name(conn, BT_AGENT_SERVICE,
+				    DBUS_NAME_FLAG_DO_NOT_QUEUE, &err);
+	if (ret != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+		fprintf(stderr, "Fail to own %s [%s]\n", BT_AGENT_SERVICE,
+			dbus_error_is_set(&err) ? err.message : "in use");
+		dbus_error_free(&err);
+		return -1;
+	}
+
+	if (!dbus_connection_register_object_path(conn, BT_AGENT_PATH,
+					&bt_bench_agent_vtable, bench) ||
+	    !dbus_connection_register_object_path(conn, BT_OBEX_AGENT_PATH,
+					&bt_bench_agent_vtable, bench)) {
+		fprintf(stderr, "Fail to register the agent paths\n");
+		return -1;
+	}
+
+	dbus_bus_add_match(conn, "type='signal',interface='"
+			   BT_SYS_POPUP_INTERFACE "',member='"
+			   BT_SYS_POPUP_METHOD_RESPONSE "'", NULL);
+	dbus_connection_add_filter(conn, __bt_bench_signal_cb, bench, NULL);
+
+	return 0;
+}
+
+/* Positive number of a key in a JSON line */
+static gboolean __bt_bench_json_value(const char *line, const char *name,
+				      gint64 *value)
+{
+	char key[64];
+	const char *pos;
+
+	snprintf(key, sizeof(key), "\"%s\":", name);
+
+	pos = strstr(line, key);
+	if (pos == NULL)
+		return FALSE;
+
+	*value = g_ascii_strtoll(pos + strlen(key), NULL, 10);
+
+	return *value > 0;
+}
+
+/* Phases of the popup in the BT_LAUNCH_TRACE line it wrote on close */
+static gboolean __bt_bench_read_trace(GPid pid, gint64 *first_frame,
+				      gint64 *clicked)
+{
+	char *contents;
+	char *line = NULL;
+	char *pos;
+	char *end;
+	char key[32];
+	gboolean found = FALSE;
+
+	if (!g_file_get_contents(BT_TRACE_FILE, &contents, NULL, NULL))
+		return FALSE;
+
+	snprintf(key, sizeof(key), "{\"pid\":%d,", pid);
+
+	/* The last one, pids may be reused during a long run */
+	for (pos = strstr(contents, key); pos; pos = strstr(pos + 1, key))
+		line = pos;
+
+	if (line) {
+		end = strchr(line, '\n');
+		if (end)
+			*end = '\0';
+
+		found = __bt_bench_json_value(line, "first_frame",
+					      first_frame) &&
+			__bt_bench_json_value(line, "user_response", clicked);
+	}
+
+	g_free(contents);
+
+	return found;
+}
+
+static gboolean __bt_bench_timeout_cb(gpointer data)
+{
+	struct bt_bench *bench = data;
+
+	fprintf(stderr, "%s: no answer in %d s\n",
+		bt_bench_events[bench->index].name, BT_BENCH_TIMEOUT);
+
+	bench->timer = 0;
+	kill(bench->pid, SIGKILL);
+
+	return FALSE;
+}
+
+/* Record the popup which has exited, and launch the next one */
+static void __bt_bench_finish(struct bt_bench *bench)
+{
+	struct bt_bench_event *event = &bt_bench_events[bench->index];
+	gint64 first_frame;
+	gint64 clicked;
+	gint64 latency;
+
+	if (bench->replied &&
+	    __bt_bench_read_trace(bench->pid, &first_frame, &clicked)) {
+		latency = first_frame - bench->launched;
+		g_array_append_val(event->visible, latency);
+		latency = bench->replied - clicked;
+		g_array_append_val(event->reply, latency);
+	} else {
+		event->failed++;
+	}
+
+	bench->index++;
+	__bt_bench_next(bench);
+}
+
+static gboolean __bt_bench_signal_wait_cb(gpointer data)
+{
+	struct bt_bench *bench = data;
+
+	bench->timer = 0;
+	__bt_bench_finish(bench);
+
+	return FALSE;
+}
+
+static void __bt_bench_exit_cb(GPid pid, gint status, gpointer data)
+{
+	struct bt_bench *bench = data;
+
+	g_spawn_close_pid(pid);
+	bench->exited = TRUE;
+
+	if (bench->timer) {
+		g_source_remove(bench->timer);
+		bench->timer = 0;
+	}
+
+	if (bench->soak) {
+		fprintf(stderr, "%s exited during the soak run\n",
+			bench->popup);
+		bench->pid = 0;
+		bench->failed = TRUE;
+		bench->done = TRUE;
+		g_main_loop_quit(bench->loop);
+		return;
+	}
+
+	/* The popup exits only once the agent acked a method reply, but
+	   a signal goes through the bus daemon and may still be on its way */
+	if (bench->replied)
+		__bt_bench_finish(bench);
+	else
+		bench->timer = g_timeout_add(BT_BENCH_SIGNAL_WAIT,
+					     __bt_bench_signal_wait_cb, bench);
+}
+
+static int __bt_bench_launch(struct bt_bench *bench)
+{
+	struct bt_bench_event *event = &bt_bench_events[bench->index];
+	const char *argv[6 + G_N_ELEMENTS(event->args)];
+	GError *err = NULL;
+	int argc = 0;
+	int i;
+
+	/* appcore hands the key and value pairs to __bluetooth_reset */
+	argv[argc++] = bench->popup;
+	argv[argc++] = "event-type";
+	argv[argc++] = event->name;
+	for (i = 0; event->args[i]; i++)
+		argv[argc++] = event->args[i];
+	if (bench->soak) {
+		argv[argc++] = BT_BENCH_SOAK_KEY;
+		argv[argc++] = "1";
+	}
+	argv[argc] = NULL;
+
+	bench->replied = 0;
+	bench->exited = FALSE;
+	bench->launched = g_get_monotonic_time();
+
+	if (!g_spawn_async(NULL, (char **)argv, NULL,
+			   G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL,
+			   &bench->pid, &err)) {
+		fprintf(stderr, "Fail to launch %s [%s]\n", bench->popup,
+			err->message);
+		g_error_free(err);
+		return -1;
+	}
+
+	g_child_watch_add(bench->pid, __bt_bench_exit_cb, bench);
+	bench->timer = g_timeout_add_seconds(BT_BENCH_TIMEOUT,
+					     __bt_bench_timeout_cb, bench);
+
+	return 0;
+}
+
+/* One popup at a time, every event type in turn */
+static void __bt_bench_next(struct bt_bench *bench)
+{
+	for (;;) {
+		if (bench->index >= G_N_ELEMENTS(bt_bench_events)) {
+			bench->index = 0;
+			bench->round++;
+		}
+
+		if (bench->round >= bench->rounds)
+			break;
+
+		if (bench->only == NULL ||
+		    !strcmp(bench->only, bt_bench_events[bench->index].name)) {
+			if (__bt_bench_launch(bench) == 0)
+				return;
+			break;
+		}
+
+		bench->index++;
+	}
+
+	bench->done = TRUE;
+	g_main_loop_quit(bench->loop);
+}
+
+/* Memory of the soak popup, between two requests */
+static gboolean __bt_bench_sample(struct bt_bench *bench,
+				  struct bt_bench_sample *sample)
+{
+	DBusMessage *msg;
+	DBusMessage *reply;
+	const char *json = NULL;
+	gboolean found = FALSE;
+
+	msg = dbus_message_new_method_call(BT_SYS_POPUP_IPC_NAME,
+					   BT_SYS_POPUP_STATS_OBJECT,
+					   BT_SYS_POPUP_INTERFACE,
+					   BT_SYS_POPUP_METHOD_GET_MEMORY_SAMPLE);
+	if (msg == NULL)
+		return FALSE;
+
+	reply = dbus_connection_send_with_reply_and_block(bench->conn, msg,
+						BT_BENCH_TIMEOUT * 1000, NULL);
+	dbus_message_unref(msg);
+	if (reply == NULL)
+		return FALSE;
+
+	if (dbus_message_get_args(reply, NULL, DBUS_TYPE_STRING, &json,
+				  DBUS_TYPE_INVALID))
+		found = __bt_bench_json_value(json, "objects",
+					      &sample->objects) &&
+			__bt_bench_json_value(json, "heap_kb",
+					      &sample->heap_kb) &&
+			__bt_bench_json_value(json, "rss_kb", &sample->rss_kb);
+
+	dbus_message_unref(reply);
+
+	return found;
+}
+
+/* Put the growth since the previous request on the type of this one */
+static gboolean __bt_bench_settle_cb(gpointer data)
+{
+	struct bt_bench *bench = data;
+	struct bt_bench_event *event = &bt_bench_events[bench->index];
+	struct bt_bench_sample sample;
+
+	bench->timer = 0;
+
+	if (!__bt_bench_sample(bench, &sample)) {
+		fprintf(stderr, "%s: no memory sample\n", event->name);
+		bench->failed = TRUE;
+		__bt_bench_soak_next(bench);
+		return FALSE;
+	}
+
+	if (bench->sampled && event->soaked >= BT_BENCH_WARMUP) {
+		event->growth.objects += sample.objects - bench->last.objects;
+		event->growth.heap_kb += sample.heap_kb - bench->last.heap_kb;
+		event->growth.rss_kb += sample.rss_kb - bench->last.rss_kb;
+	}
+
+	event->soaked++;
+	bench->last = sample;
+	bench->sampled = TRUE;
+	bench->sent++;
+	bench->index++;
+	__bt_bench_soak_next(bench);
+
+	return FALSE;
+}
+
+/* The first request launches the popup, the others go to it over D-Bus */
+static int __bt_bench_soak_send(struct bt_bench *bench)
+{
+	struct bt_bench_event *event = &bt_bench_events[bench->index];
+	const char *args[2 + G_N_ELEMENTS(event->args)];
+	const char **argp = args;
+	DBusMessage *msg;
+	int count = 0;
+	int i;
+
+	if (bench->pid == 0)
+		return __bt_bench_launch(bench);
+
+	args[count++] = "event-type";
+	args[count++] = event->name;
+	for (i = 0; event->args[i]; i++)
+		args[count++] = event->args[i];
+
+	msg = dbus_message_new_method_call(BT_SYS_POPUP_IPC_NAME,
+					   BT_SYS_POPUP_STATS_OBJECT,
+					   BT_SYS_POPUP_INTERFACE,
+					   BT_SYS_POPUP_METHOD_BENCH_REQUEST);
+	if (msg == NULL)
+		return -1;
+
+	dbus_message_append_args(msg, DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+				 &argp, count, DBUS_TYPE_INVALID);
+	dbus_message_set_no_reply(msg, TRUE);
+
+	bench->replied = 0;
+	dbus_connection_send(bench->conn, msg, NULL);
+	dbus_message_unref(msg);
+
+	bench->timer = g_timeout_add_seconds(BT_BENCH_TIMEOUT,
+					     __bt_bench_timeout_cb, bench);
+
+	return 0;
+}
+
+/* One request at a time, every event type in turn */
+static void __bt_bench_soak_next(struct bt_bench *bench)
+{
+	while (bench->sent < bench->soak && !bench->failed) {
+		if (bench->index >= G_N_ELEMENTS(bt_bench_events))
+			bench->index = 0;
+
+		if (bench->only &&
+		    strcmp(bench->only, bt_bench_events[bench->index].name)) {
+			bench->index++;
+			continue;
+		}
+
+		if (__bt_bench_soak_send(bench) == 0)
+			return;
+
+		bench->failed = TRUE;
+	}
+
+	bench->done = TRUE;
+	g_main_loop_quit(bench->loop);
+}
+
+/* Growth of each type past its warm-up, FALSE when one grows */
+static gboolean __bt_bench_soak_report(struct bt_bench *bench)
+{
+	struct bt_bench_event *event;
+	struct bt_bench_sample *growth;
+	gboolean settled = TRUE;
+	gboolean grows;
+	int i;
+
+	printf("Growth per event type over %d requests, %d warm-up requests "
+	       "each not accounted\n", bench->sent, BT_BENCH_WARMUP);
+
+	for (i = 0; i < G_N_ELEMENTS(bt_bench_events); i++) {
+		event = &bt_bench_events[i];
+		if (event->soaked == 0)
+			continue;
+
+		growth = &event->growth;
+		grows = growth->objects > BT_BENCH_OBJECT_SLACK ||
+			growth->heap_kb > BT_BENCH_HEAP_SLACK_KB ||
+			growth->rss_kb > BT_BENCH_RSS_SLACK_KB;
+		if (grows)
+			settled = FALSE;
+
+		printf("%-26s n=%-6d objects=%+-6lld heap=%+-8lldKB "
+		       "rss=%+lldKB%s\n", event->name, event->soaked,
+		       (long long)growth->objects, (long long)growth->heap_kb,
+		       (long long)growth->rss_kb, grows ? "  GROWS" : "");
+	}
+
+	return settled;
+}
+
+static gint __bt_bench_compare(gconstpointer a, gconstpointer b)
+{
+	gint64 x = *(const gint64 *)a;
+	gint64 y = *(const gint64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest rank */
+static gint64 __bt_bench_percentile(GArray *samples, int percent)
+{
+	guint rank;
+
+	if (samples->len == 0)
+		return 0;
+
+	rank = (samples->len * percent + 99) / 100;
+
+	return g_array_index(samples, gint64, rank ? rank - 1 : 0);
+}
+
+static void __bt_bench_report(const char *name, const char *latency,
+			      GArray *samples)
+{
+	g_array_sort(samples, __bt_bench_compare);
+
+	printf("%-26s %-18s n=%-4u p50=%-8lld p90=%-8lld p99=%-8lld "
+	       "max=%lld\n", name, latency, samples->len,
+	       (long long)__bt_bench_percentile(samples, 50),
+	       (long long)__bt_bench_percentile(samples, 90),
+	       (long long)__bt_bench_percentile(samples, 99),
+	       (long long)__bt_bench_percentile(samples, 100));
+}
+
+int main(int argc, char *argv[])
+{
+	struct bt_bench bench;
+	struct bt_bench_event *event;
+	gboolean known = FALSE;
+	int i;
+
+	memset(&bench, 0x0, sizeof(bench));
+	bench.rounds = BT_BENCH_ROUNDS;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+			bench.rounds = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-e") && i + 1 < argc) {
+			bench.only = argv[++i];
+		} else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+			bench.soak = atoi(argv[++i]);
+		} else if (argv[i][0] == '-' || bench.popup) {
+			bench.popup = NULL;
+			break;
+		} else {
+			bench.popup = argv[i];
+		}
+	}
+
+	for (i = 0; bench.only && i < G_N_ELEMENTS(bt_bench_events); i++) {
+		if (!strcmp(bench.only, bt_bench_events[i].name))
+			known = TRUE;
+	}
+
+	if (bench.popup == NULL || bench.rounds <= 0 || bench.soak < 0 ||
+	    (bench.only && !known)) {
+		fprintf(stderr, "usage: %s [-n rounds] [-e event-type] "
+			"[-s requests] bt-syspopup\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	g_type_init();
+
+	if (__bt_bench_init_agent(&bench) < 0)
+		return EXIT_FAILURE;
+
+	for (i = 0; i < G_N_ELEMENTS(bt_bench_events); i++) {
+		bt_bench_events[i].visible = g_array_new(FALSE, FALSE,
+							 sizeof(gint64));
+		bt_bench_events[i].reply = g_array_new(FALSE, FALSE,
+						       sizeof(gint64));
+	}
+
+	/* Only the lines of this run */
+	g_file_set_contents(BT_TRACE_FILE, "", 0, NULL);
+
+	bench.loop = g_main_loop_new(NULL, FALSE);
+
+	if (bench.soak) {
+		__bt_bench_soak_next(&bench);
+		if (!bench.done)
+			g_main_loop_run(bench.loop);
+
+		/* Resident, it would wait for its idle timeout */
+		if (bench.pid)
+			kill(bench.pid, SIGTERM);
+
+		if (!__bt_bench_soak_report(&bench))
+			bench.failed = TRUE;
+
+		g_main_loop_unref(bench.loop);
+
+		return bench.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	__bt_bench_next(&bench);
+	if (!bench.done)
+		g_main_loop_run(bench.loop);
+
+	printf("Latencies in usec, %d rounds\n", bench.rounds);
+
+	for (i = 0; i < G_N_ELEMENTS(bt_bench_events); i++) {
+		event = &bt_bench_events[i];
+		if (event->visible->len == 0 && event->failed == 0)
+			continue;
+
+		__bt_bench_report(event->name, "launch-to-visible",
+				  event->visible);
+		__bt_bench_report(event->name, "click-to-reply",
+				  event->reply);
+		if (event->failed)
+			printf("%-26s failed=%d\n", event->name,
+			       event->failed);
+	}
+
+	g_main_loop_unref(bench.loop);
+
+	return EXIT_SUCCESS;
+}
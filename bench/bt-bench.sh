@@ -0,0 +1,40 @@
+#!/bin/sh
+# Run bt-bench on a private bus and a virtual X server:
+#   bench/bt-bench.sh <build dir> [-n rounds] [-e event-type]
+#   bench/bt-bench.sh <build dir> -s requests [-e event-type]
+# The build needs -DENABLE_BENCHMARK=ON, and the popup the Tizen libraries
+# it links to, e.g. in the build root.
+#
+# Every event type answered through a popup is measured. Left out are
+# passkey-display-request, which draws nothing and sends no reply, and the
+# "none" type of app-confirm-request and bt-information, which goes to the
+# ticker.
+#
+# With -s, a soak run replays that many mixed requests against one popup
+# process and exits non-zero when an event type keeps it growing, e.g.
+#   bench/bt-bench.sh build -s 30000
+
+BUILD_DIR=${1:?usage: $0 <build dir> [-n rounds] [-e event-type] [-s requests]}
+shift
+
+BT_BENCH_DISPLAY=${BT_BENCH_DISPLAY:-:99}
+
+Xvfb $BT_BENCH_DISPLAY -screen 0 480x800x24 -nolisten tcp >/dev/null 2>&1 &
+XVFB_PID=$!
+
+# Session policy, so the stand-in may own the agent name
+DBUS_INFO=$(dbus-daemon --session --fork --print-address=1 --print-pid=1)
+DBUS_ADDRESS=$(echo "$DBUS_INFO" | sed -n 1p)
+DBUS_PID=$(echo "$DBUS_INFO" | sed -n 2p)
+
+trap 'kill $XVFB_PID $DBUS_PID 2>/dev/null' EXIT INT TERM
+
+for i in $(seq 50); do
+	xdpyinfo -display $BT_BENCH_DISPLAY >/dev/null 2>&1 && break
+	sleep 0.1
+done
+
+DISPLAY=$BT_BENCH_DISPLAY \
+DBUS_SYSTEM_BUS_ADDRESS=$DBUS_ADDRESS \
+ELM_ENGINE=software_x11 \
+	"$BUILD_DIR/bench/bt-bench" "$@" "$BUILD_DIR/bt-syspopup"
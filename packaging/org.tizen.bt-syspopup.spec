@@ -26,6 +26,7 @@ BuildRequires:  pkgconfig(dbus-glib-1)
 BuildRequires:  pkgconfig(glib-2.0)
 BuildRequires:  pkgconfig(devman_haptic)
 BuildRequires:  pkgconfig(aul)
+BuildRequires:  pkgconfig(notification)
 BuildRequires:  sysman-internal-devel
 
 BuildRequires:  cmake
@@ -52,5 +53,7 @@ rm -rf %{buildroot}
 %defattr(-,root,root,-)
 %{_usrdir}/share/packages/org.tizen.bt-syspopup.xml
 %{_appdir}/org.tizen.bt-syspopup/bin/bt-syspopup
+%{_bindir}/bt-recorder-dump
+%{_appdir}/org.tizen.bt-syspopup/res/locale/*/LC_MESSAGES/bt-syspopup.mo
 %{_optdir}/share/icons/default/small/org.tizen.bt-syspopup.png
 %{_optdir}/share/process-info/bt-syspopup.ini
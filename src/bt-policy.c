@@ -0,0 +1,245 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "bt-syspopup.h"
+#include "bt-policy.h"
+
+static const char *bt_policy_action_str[] = {
+	[BT_POLICY_ASK] = "ask",
+	[BT_POLICY_ACCEPT] = "accept",
+	[BT_POLICY_REJECT] = "reject",
+};
+
+const char *bt_policy_action_name(bt_policy_action_t action)
+{
+	return bt_policy_action_str[action];
+}
+
+static gboolean __bt_policy_parse_action(const char *str,
+					 bt_policy_action_t *action)
+{
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS(bt_policy_action_str); i++) {
+		if (!g_ascii_strcasecmp(str, bt_policy_action_str[i])) {
+			*action = i;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* Addresses are compared upper case and service UUIDs lower case */
+static GPatternSpec *__bt_policy_get_pattern(GKeyFile *key_file,
+					     const char *group,
+					     const char *key,
+					     gboolean upper)
+{
+	GPatternSpec *pattern;
+	char *value;
+	char *folded;
+
+	value = g_key_file_get_string(key_file, group, key, NULL);
+	if (value == NULL)
+		return NULL;
+
+	folded = upper ? g_ascii_strup(value, -1) : g_ascii_strdown(value, -1);
+	pattern = g_pattern_spec_new(folded);
+
+	g_free(folded);
+	g_free(value);
+
+	return pattern;
+}
+
+static void __bt_policy_clear_rule(struct bt_policy_rule *rule)
+{
+	g_free(rule->name);
+	g_strfreev(rule->events);
+
+	if (rule->address)
+		g_pattern_spec_free(rule->address);
+	if (rule->device_name)
+		g_pattern_spec_free(rule->device_name);
+	if (rule->service)
+		g_pattern_spec_free(rule->service);
+}
+
+static gboolean __bt_policy_parse_rule(GKeyFile *key_file, const char *group,
+				       struct bt_policy_rule *rule)
+{
+	char *action;
+	gboolean ret;
+
+	memset(rule, 0x0, sizeof(struct bt_policy_rule));
+
+	rule->events = g_key_file_get_string_list(key_file, group, "events",
+						  NULL, NULL);
+	action = g_key_file_get_string(key_file, group, "action", NULL);
+
+	if (rule->events == NULL || action == NULL) {
+		bt_log_print(BT_POPUP, "Rule [%s] needs events and action",
+			     group);
+		g_strfreev(rule->events);
+		g_free(action);
+		return FALSE;
+	}
+
+	ret = __bt_policy_parse_action(action, &rule->action);
+	g_free(action);
+
+	if (!ret) {
+		bt_log_print(BT_POPUP, "Rule [%s] has an unknown action",
+			     group);
+		g_strfreev(rule->events);
+		return FALSE;
+	}
+
+	rule->name = g_strdup(group);
+	rule->address = __bt_policy_get_pattern(key_file, group, "address",
+						TRUE);
+	rule->device_name = __bt_policy_get_pattern(key_file, group, "name",
+						    FALSE);
+	rule->service = __bt_policy_get_pattern(key_file, group, "service",
+						FALSE);
+
+	return TRUE;
+}
+
+/* NULL when there is no policy file or it has no valid rule */
+struct bt_policy *bt_policy_load(const char *path)
+{
+	struct bt_policy *policy;
+	GKeyFile *key_file;
+	GError *err = NULL;
+	char **groups;
+	gsize count = 0;
+	int i;
+
+	key_file = g_key_file_new();
+
+	if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE,
+				       &err)) {
+		if (!g_error_matches(err, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			bt_log_print(BT_POPUP, "Fail to load %s [%s]", path,
+				     err->message);
+		g_error_free(err);
+		g_key_file_free(key_file);
+		return NULL;
+	}
+
+	groups = g_key_file_get_groups(key_file, &count);
+
+	policy = g_new0(struct bt_policy, 1);
+	policy->rules = g_new0(struct bt_policy_rule, count);
+
+	for (i = 0; i < count; i++) {
+		if (__bt_policy_parse_rule(key_file, groups[i],
+					   &policy->rules[policy->count]))
+			policy->count++;
+	}
+
+	g_strfreev(groups);
+	g_key_file_free(key_file);
+
+	bt_log_print(BT_POPUP, "%d policy rules from %s", policy->count, path);
+
+	if (policy->count == 0) {
+		bt_policy_free(policy);
+		return NULL;
+	}
+
+	return policy;
+}
+
+void bt_policy_free(struct bt_policy *policy)
+{
+	int i;
+
+	if (policy == NULL)
+		return;
+
+	for (i = 0; i < policy->count; i++)
+		__bt_policy_clear_rule(&policy->rules[i]);
+
+	g_free(policy->rules);
+	g_free(policy);
+}
+
+static gboolean __bt_policy_match_pattern(GPatternSpec *pattern,
+					  const char *value,
+					  gboolean upper)
+{
+	char *folded;
+	gboolean ret;
+
+	if (pattern == NULL)
+		return TRUE;
+
+	if (value == NULL)
+		return FALSE;
+
+	folded = upper ? g_ascii_strup(value, -1) : g_ascii_strdown(value, -1);
+	ret = g_pattern_match_string(pattern, folded);
+	g_free(folded);
+
+	return ret;
+}
+
+static gboolean __bt_policy_has_event(const struct bt_policy_rule *rule,
+				      const char *event)
+{
+	int i;
+
+	for (i = 0; rule->events[i]; i++) {
+		if (!strcmp(rule->events[i], event))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* First rule of the file matching the request, or NULL */
+const struct bt_policy_rule *bt_policy_match(const struct bt_policy *policy,
+					     const char *event,
+					     const char *address,
+					     const char *device_name,
+					     const char *service)
+{
+	const struct bt_policy_rule *rule;
+	int i;
+
+	if (policy == NULL || event == NULL)
+		return NULL;
+
+	for (i = 0; i < policy->count; i++) {
+		rule = &policy->rules[i];
+
+		if (!__bt_policy_has_event(rule, event))
+			continue;
+
+		if (__bt_policy_match_pattern(rule->address, address, TRUE) &&
+		    __bt_policy_match_pattern(rule->device_name, device_name,
+					      FALSE) &&
+		    __bt_policy_match_pattern(rule->service, service, FALSE))
+			return rule;
+	}
+
+	return NULL;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DEF_BT_POLICY_H_
+#define __DEF_BT_POLICY_H_
+
+#include <glib.h>
+
+/* Answers given without asking, for trusted devices and services.
+ *
+ * Each group of the policy file is a rule, checked in file order:
+ *
+ *	[fleet-headsets]
+ *	events=authorize-request;exchange-request
+ *	address=00:1A:7D:*
+ *	name=Headset-*
+ *	service=0000111e-*
+ *	action=accept
+ *
+ * address, name and service are glob patterns and may be left out.
+ * action is accept, reject or ask. The first rule matching a request
+ * decides it; ask shows the popup as if no rule matched.
+ */
+
+typedef enum {
+	BT_POLICY_ASK,
+	BT_POLICY_ACCEPT,
+	BT_POLICY_REJECT,
+} bt_policy_action_t;
+
+struct bt_policy_rule {
+	char *name;		/* Group of the policy file */
+	char **events;
+	GPatternSpec *address;
+	GPatternSpec *device_name;
+	GPatternSpec *service;
+	bt_policy_action_t action;
+};
+
+struct bt_policy {
+	struct bt_policy_rule *rules;
+	int count;
+};
+
+struct bt_policy *bt_policy_load(const char *path);
+
+void bt_policy_free(struct bt_policy *policy);
+
+const struct bt_policy_rule *bt_policy_match(const struct bt_policy *policy,
+					     const char *event,
+					     const char *address,
+					     const char *device_name,
+					     const char *service);
+
+const char *bt_policy_action_name(bt_policy_action_t action);
+
+#endif				/* __DEF_BT_POLICY_H_ */
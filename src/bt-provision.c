@@ -0,0 +1,187 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bt-syspopup.h"
+#include "bt-provision.h"
+
+static gboolean __bt_provision_valid_code(const char *key, const char *code)
+{
+	if (code[0] != '\0' && strlen(code) <= BT_PIN_MLEN)
+		return TRUE;
+
+	bt_log_print(BT_POPUP, "Invalid code for [%s]", key);
+
+	return FALSE;
+}
+
+static void __bt_provision_load_addresses(struct bt_provision_store *store,
+					  GKeyFile *key_file)
+{
+	char **keys;
+	char *code;
+	int i;
+
+	keys = g_key_file_get_keys(key_file, "address", NULL, NULL);
+	if (keys == NULL)
+		return;
+
+	for (i = 0; keys[i]; i++) {
+		code = g_key_file_get_string(key_file, "address", keys[i],
+					     NULL);
+		if (code == NULL || !__bt_provision_valid_code(keys[i], code)) {
+			g_free(code);
+			continue;
+		}
+
+		g_hash_table_replace(store->addresses,
+				     g_ascii_strup(keys[i], -1), code);
+	}
+
+	g_strfreev(keys);
+}
+
+static int __bt_provision_prefix_cmp(const void *a, const void *b)
+{
+	const struct bt_provision_prefix *pa = a;
+	const struct bt_provision_prefix *pb = b;
+
+	return strlen(pb->prefix) - strlen(pa->prefix);
+}
+
+static void __bt_provision_load_prefixes(struct bt_provision_store *store,
+					 GKeyFile *key_file)
+{
+	struct bt_provision_prefix *entry;
+	gsize count = 0;
+	char **keys;
+	char *code;
+	int i;
+
+	keys = g_key_file_get_keys(key_file, "name", &count, NULL);
+	if (keys == NULL)
+		return;
+
+	store->prefixes = g_new0(struct bt_provision_prefix, count);
+
+	for (i = 0; keys[i]; i++) {
+		code = g_key_file_get_string(key_file, "name", keys[i], NULL);
+		if (code == NULL || !__bt_provision_valid_code(keys[i], code)) {
+			g_free(code);
+			continue;
+		}
+
+		entry = &store->prefixes[store->prefix_count++];
+		entry->prefix = g_strdup(keys[i]);
+		entry->code = code;
+	}
+
+	g_strfreev(keys);
+
+	qsort(store->prefixes, store->prefix_count,
+	      sizeof(struct bt_provision_prefix), __bt_provision_prefix_cmp);
+}
+
+/* NULL when there is no store file or it has no valid code */
+struct bt_provision_store *bt_provision_load(const char *path)
+{
+	struct bt_provision_store *store;
+	GKeyFile *key_file;
+	GError *err = NULL;
+
+	key_file = g_key_file_new();
+
+	if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE,
+				       &err)) {
+		if (!g_error_matches(err, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			bt_log_print(BT_POPUP, "Fail to load %s [%s]", path,
+				     err->message);
+		g_error_free(err);
+		g_key_file_free(key_file);
+		return NULL;
+	}
+
+	store = g_new0(struct bt_provision_store, 1);
+	store->addresses = g_hash_table_new_full(g_str_hash, g_str_equal,
+						 g_free, g_free);
+
+	__bt_provision_load_addresses(store, key_file);
+	__bt_provision_load_prefixes(store, key_file);
+
+	g_key_file_free(key_file);
+
+	bt_log_print(BT_POPUP, "%d addresses, %d name prefixes from %s",
+		     g_hash_table_size(store->addresses), store->prefix_count,
+		     path);
+
+	if (g_hash_table_size(store->addresses) == 0 &&
+	    store->prefix_count == 0) {
+		bt_provision_free(store);
+		return NULL;
+	}
+
+	return store;
+}
+
+void bt_provision_free(struct bt_provision_store *store)
+{
+	int i;
+
+	if (store == NULL)
+		return;
+
+	for (i = 0; i < store->prefix_count; i++) {
+		g_free(store->prefixes[i].prefix);
+		g_free(store->prefixes[i].code);
+	}
+
+	g_free(store->prefixes);
+	g_hash_table_destroy(store->addresses);
+	g_free(store);
+}
+
+const char *bt_provision_lookup(const struct bt_provision_store *store,
+				const char *address,
+				const char *device_name)
+{
+	const char *code;
+	char *key;
+	int i;
+
+	if (store == NULL)
+		return NULL;
+
+	if (address) {
+		key = g_ascii_strup(address, -1);
+		code = g_hash_table_lookup(store->addresses, key);
+		g_free(key);
+
+		if (code)
+			return code;
+	}
+
+	if (device_name == NULL)
+		return NULL;
+
+	for (i = 0; i < store->prefix_count; i++) {
+		if (g_str_has_prefix(device_name, store->prefixes[i].prefix))
+			return store->prefixes[i].code;
+	}
+
+	return NULL;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DEF_BT_PROVISION_H_
+#define __DEF_BT_PROVISION_H_
+
+#include <glib.h>
+
+/* PIN codes and passkeys given to devices paired in bulk.
+ *
+ *	[address]
+ *	00:1A:7D:DA:71:13=0000
+ *	[name]
+ *	Scanner-=1234
+ *
+ * An exact device address is looked up first, then the longest name
+ * prefix matching the device name.
+ */
+
+struct bt_provision_prefix {
+	char *prefix;
+	char *code;
+};
+
+struct bt_provision_store {
+	GHashTable *addresses;	/* Upper case address to code */
+	struct bt_provision_prefix *prefixes;	/* Longest first */
+	int prefix_count;
+};
+
+struct bt_provision_store *bt_provision_load(const char *path);
+
+void bt_provision_free(struct bt_provision_store *store);
+
+const char *bt_provision_lookup(const struct bt_provision_store *store,
+				const char *address,
+				const char *device_name);
+
+#endif				/* __DEF_BT_PROVISION_H_ */
@@ -0,0 +1,217 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Dump the flight recorder of bt-syspopup, oldest entry first, or with
+   -s the statistics of each event type */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bt-recorder.h"
+
+static void __bt_dump_time(const char *name, uint32_t us, int json)
+{
+	if (json) {
+		if (us == BT_RECORDER_NO_TIME)
+			printf(",\"%s_us\":null", name);
+		else
+			printf(",\"%s_us\":%u", name, us);
+	} else {
+		if (us == BT_RECORDER_NO_TIME)
+			printf(" %s=-", name);
+		else
+			printf(" %s=%u.%03ums", name, us / 1000, us % 1000);
+	}
+}
+
+static void __bt_dump_entry(const struct bt_recorder_entry *entry, int json)
+{
+	char date[32] = { 0 };
+	time_t sec = entry->arrival_us / 1000000;
+	struct tm tm;
+
+	if (localtime_r(&sec, &tm))
+		strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+
+	if (json)
+		printf("{\"seq\":%u,\"arrival_us\":%lld,\"event\":%u,"
+		       "\"device\":\"%08x\",\"reason\":\"%s\","
+		       "\"response\":\"%s\"", entry->seq,
+		       (long long)entry->arrival_us, entry->event_type,
+		       entry->device_hash,
+		       bt_recorder_reason_name(entry->reason),
+		       bt_recorder_response_name(entry->response));
+	else
+		printf("%6u %s.%06d event=0x%04x device=%08x %s/%s",
+		       entry->seq, date, (int)(entry->arrival_us % 1000000),
+		       entry->event_type, entry->device_hash,
+		       bt_recorder_reason_name(entry->reason),
+		       bt_recorder_response_name(entry->response));
+
+	__bt_dump_time("shown", entry->shown_us, json);
+	__bt_dump_time("answered", entry->answered_us, json);
+	__bt_dump_time("replied", entry->replied_us, json);
+
+	printf(json ? "}" : "\n");
+}
+
+static void __bt_dump_hist(const char *name, const struct bt_histogram *hist,
+			   int json)
+{
+	long long mean = hist->count ? hist->total_us / hist->count : 0;
+	int i;
+
+	if (!json) {
+		printf(" %s[n=%u mean=%lld p50=%lld p99=%lld max=%lld]", name,
+		       hist->count, mean,
+		       (long long)bt_histogram_percentile(hist, 50),
+		       (long long)bt_histogram_percentile(hist, 99),
+		       (long long)hist->max_us);
+		return;
+	}
+
+	printf(",\"%s\":{\"count\":%u,\"mean_us\":%lld,\"p50_us\":%lld,"
+	       "\"p99_us\":%lld,\"max_us\":%lld,\"buckets\":[", name,
+	       hist->count, mean,
+	       (long long)bt_histogram_percentile(hist, 50),
+	       (long long)bt_histogram_percentile(hist, 99),
+	       (long long)hist->max_us);
+
+	for (i = 0; i < BT_HIST_BUCKETS; i++)
+		printf("%s%u", i ? "," : "", hist->buckets[i]);
+
+	printf("]}");
+}
+
+static void __bt_dump_stats(const struct bt_recorder_file *file, int json)
+{
+	const struct bt_event_stats *stats;
+	int first = 1;
+	int i;
+
+	if (json)
+		printf("{");
+
+	for (i = 0; i < BT_RECORDER_EVENT_MAX; i++) {
+		stats = &file->stats[i];
+		if (stats->count == 0 && stats->create_failed == 0)
+			continue;
+
+		if (json)
+			printf("%s\"0x%04x\":{\"count\":%u,\"accept\":%u,"
+			       "\"reject\":%u,\"cancel\":%u,\"timeout\":%u,"
+			       "\"create_failed\":%u", first ? "" : ",",
+			       1 << i, stats->count, stats->accept,
+			       stats->reject, stats->cancel, stats->timeout,
+			       stats->create_failed);
+		else
+			printf("event=0x%04x count=%u accept=%u reject=%u "
+			       "cancel=%u timeout=%u create_failed=%u", 1 << i,
+			       stats->count, stats->accept, stats->reject,
+			       stats->cancel, stats->timeout,
+			       stats->create_failed);
+
+		__bt_dump_hist("visible", &stats->visible, json);
+		__bt_dump_hist("decision", &stats->decision, json);
+		__bt_dump_hist("reply", &stats->reply, json);
+
+		printf(json ? "}" : "\n");
+		first = 0;
+	}
+
+	if (json)
+		printf("}\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const struct bt_recorder_file *file;
+	const char *path = BT_RECORDER_FILE;
+	struct stat st;
+	uint32_t start;
+	uint32_t head;
+	uint32_t seq;
+	int json = 0;
+	int stats = 0;
+	int fd;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-j")) {
+			json = 1;
+		} else if (!strcmp(argv[i], "-s")) {
+			stats = 1;
+		} else if (argv[i][0] == '-') {
+			fprintf(stderr, "usage: %s [-j] [-s] [file]\n",
+				argv[0]);
+			return EXIT_FAILURE;
+		} else {
+			path = argv[i];
+		}
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(path);
+		return EXIT_FAILURE;
+	}
+
+	file = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (file == MAP_FAILED) {
+		perror(path);
+		return EXIT_FAILURE;
+	}
+
+	if (!bt_recorder_valid(file, st.st_size)) {
+		fprintf(stderr, "%s: not a flight recorder file\n", path);
+		return EXIT_FAILURE;
+	}
+
+	if (stats) {
+		__bt_dump_stats(file, json);
+		munmap((void *)file, st.st_size);
+		return EXIT_SUCCESS;
+	}
+
+	head = file->header.head;
+	start = head > file->header.capacity ?
+		head - file->header.capacity : 0;
+
+	if (json)
+		printf("[");
+
+	for (seq = start; seq < head; seq++) {
+		if (json && seq != start)
+			printf(",");
+		__bt_dump_entry(&file->entries[seq % file->header.capacity],
+				json);
+	}
+
+	if (json)
+		printf("]\n");
+
+	munmap((void *)file, st.st_size);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bt-recorder.h"
+
+#define BT_RECORDER_SIZE sizeof(struct bt_recorder_file)
+
+static struct bt_recorder_file *recorder;
+
+static const char *bt_record_reason_str[BT_RECORD_REASON_MAX] = {
+	[BT_RECORD_UNANSWERED] = "unanswered",
+	[BT_RECORD_USER] = "user",
+	[BT_RECORD_TIMEOUT] = "timeout",
+	[BT_RECORD_EXPIRED] = "expired",
+	[BT_RECORD_AGENT_CANCEL] = "agent-cancel",
+	[BT_RECORD_TERMINATED] = "terminated",
+	[BT_RECORD_GRANT] = "grant",
+	[BT_RECORD_POLICY] = "policy",
+	[BT_RECORD_PROVISIONED] = "provisioned",
+	[BT_RECORD_TICKER] = "ticker",
+	[BT_RECORD_QUEUE_FULL] = "queue-full",
+	[BT_RECORD_ERROR] = "error",
+};
+
+static const char *bt_record_response_str[BT_RECORD_RESPONSE_MAX] = {
+	[BT_RECORD_RESPONSE_NONE] = "none",
+	[BT_RECORD_RESPONSE_ACCEPT] = "accept",
+	[BT_RECORD_RESPONSE_REJECT] = "reject",
+	[BT_RECORD_RESPONSE_CANCEL] = "cancel",
+	[BT_RECORD_RESPONSE_ACCEPT_ALL] = "accept-all",
+};
+
+const char *bt_recorder_reason_name(uint8_t reason)
+{
+	return reason < BT_RECORD_REASON_MAX ?
+		bt_record_reason_str[reason] : "?";
+}
+
+const char *bt_recorder_response_name(uint8_t response)
+{
+	return response < BT_RECORD_RESPONSE_MAX ?
+		bt_record_response_str[response] : "?";
+}
+
+/* FNV-1a, the same value on every build of the recorder and the reader */
+uint32_t bt_recorder_hash(const char *str)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*str) {
+		hash ^= (unsigned char)*str++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+int bt_recorder_valid(const struct bt_recorder_file *file, size_t size)
+{
+	return size >= sizeof(struct bt_recorder_file) &&
+	       file->header.magic == BT_RECORDER_MAGIC &&
+	       file->header.version == BT_RECORDER_VERSION &&
+	       file->header.entry_size == sizeof(struct bt_recorder_entry) &&
+	       file->header.capacity == BT_RECORDER_CAPACITY;
+}
+
+static void *__bt_recorder_map_file(const char *path, int *err)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		*err = -errno;
+		return MAP_FAILED;
+	}
+
+	if (fstat(fd, &st) < 0 ||
+	    (st.st_size != BT_RECORDER_SIZE &&
+	     ftruncate(fd, BT_RECORDER_SIZE) < 0)) {
+		*err = -errno;
+		close(fd);
+		return MAP_FAILED;
+	}
+
+	map = mmap(NULL, BT_RECORDER_SIZE, PROT_READ | PROT_WRITE,
+		   MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		*err = -errno;
+
+	close(fd);
+
+	return map;
+}
+
+/* Map the file, keeping the entries and statistics of earlier runs when
+   it is valid. Without the file, they are kept in anonymous memory for
+   the life of the process. Returns 0 or a negative errno. */
+int bt_recorder_open(const char *path)
+{
+	void *map;
+	int err = 0;
+
+	if (recorder)
+		return 0;
+
+	map = __bt_recorder_map_file(path, &err);
+	if (map == MAP_FAILED)
+		map = mmap(NULL, BT_RECORDER_SIZE, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (map == MAP_FAILED)
+		return err ? err : -errno;
+
+	recorder = map;
+
+	if (!bt_recorder_valid(recorder, BT_RECORDER_SIZE)) {
+		memset(recorder, 0x0, BT_RECORDER_SIZE);
+		recorder->header.magic = BT_RECORDER_MAGIC;
+		recorder->header.version = BT_RECORDER_VERSION;
+		recorder->header.entry_size = sizeof(struct bt_recorder_entry);
+		recorder->header.capacity = BT_RECORDER_CAPACITY;
+	}
+
+	return err;
+}
+
+void bt_recorder_close(void)
+{
+	if (recorder == NULL)
+		return;
+
+	munmap(recorder, BT_RECORDER_SIZE);
+	recorder = NULL;
+}
+
+/* The entry is complete before head moves, a reader never sees it half
+   written */
+void bt_recorder_append(struct bt_recorder_entry *entry)
+{
+	uint32_t head;
+
+	if (recorder == NULL)
+		return;
+
+	head = recorder->header.head;
+	entry->seq = head;
+	recorder->entries[head % BT_RECORDER_CAPACITY] = *entry;
+
+	__sync_synchronize();
+	recorder->header.head = head + 1;
+}
+
+/* Statistics of a single bt_popup_event_type_t, NULL when not mapped */
+struct bt_event_stats *bt_recorder_stats(uint16_t event_type)
+{
+	int index;
+
+	if (recorder == NULL || event_type == 0)
+		return NULL;
+
+	index = __builtin_ctz(event_type);
+	if (index >= BT_RECORDER_EVENT_MAX)
+		return NULL;
+
+	return &recorder->stats[index];
+}
+
+void bt_recorder_reset_stats(void)
+{
+	if (recorder)
+		memset(recorder->stats, 0x0, sizeof(recorder->stats));
+}
+
+void bt_histogram_add(struct bt_histogram *hist, int64_t us)
+{
+	int bucket = 0;
+
+	if (us < 0)
+		us = 0;
+
+	while (bucket < BT_HIST_BUCKETS - 1 && us >= ((int64_t)1 << bucket))
+		bucket++;
+
+	hist->buckets[bucket]++;
+	hist->count++;
+	hist->total_us += us;
+	if (us > hist->max_us)
+		hist->max_us = us;
+}
+
+/* Upper bound of the bucket holding the percentile */
+int64_t bt_histogram_percentile(const struct bt_histogram *hist, int percent)
+{
+	uint32_t target;
+	uint32_t seen = 0;
+	int i;
+
+	if (hist->count == 0)
+		return 0;
+
+	target = ((uint64_t)hist->count * percent + 99) / 100;
+
+	for (i = 0; i < BT_HIST_BUCKETS - 1; i++) {
+		seen += hist->buckets[i];
+		if (seen >= target)
+			break;
+	}
+
+	if (((int64_t)1 << i) < hist->max_us)
+		return (int64_t)1 << i;
+
+	return hist->max_us;
+}
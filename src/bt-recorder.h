@@ -0,0 +1,138 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DEF_BT_RECORDER_H_
+#define __DEF_BT_RECORDER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Flight recorder: a memory mapped ring of one binary entry per request,
+ * followed by the latency and outcome statistics of each event type.
+ * Both are plain stores into a MAP_SHARED file, so they outlive the
+ * process and are read back by bt-recorder-dump.
+ */
+
+#ifndef BT_RECORDER_FILE
+#define BT_RECORDER_FILE	"/opt/var/log/bt-syspopup.rec"
+#endif
+
+#define BT_RECORDER_MAGIC	0x52464642	/* "BFFR" */
+#define BT_RECORDER_VERSION	2
+#define BT_RECORDER_CAPACITY	1024
+#define BT_RECORDER_EVENT_MAX	16	/* Bits of bt_popup_event_type_t */
+#define BT_HIST_BUCKETS		28	/* Powers of two usec, the last ~2 min */
+
+#define BT_RECORDER_NO_TIME	0xffffffff	/* Phase not reached */
+
+/* Why a request ended */
+typedef enum {
+	BT_RECORD_UNANSWERED,	/* Nothing waited for an answer */
+	BT_RECORD_USER,
+	BT_RECORD_TIMEOUT,
+	BT_RECORD_EXPIRED,	/* Deadline passed before it was shown */
+	BT_RECORD_AGENT_CANCEL,
+	BT_RECORD_TERMINATED,
+	BT_RECORD_GRANT,
+	BT_RECORD_POLICY,
+	BT_RECORD_PROVISIONED,
+	BT_RECORD_TICKER,
+	BT_RECORD_QUEUE_FULL,
+	BT_RECORD_ERROR,
+	BT_RECORD_REASON_MAX,
+} bt_record_reason_t;
+
+/* Answer given to the agent */
+typedef enum {
+	BT_RECORD_RESPONSE_NONE,
+	BT_RECORD_RESPONSE_ACCEPT,
+	BT_RECORD_RESPONSE_REJECT,
+	BT_RECORD_RESPONSE_CANCEL,
+	BT_RECORD_RESPONSE_ACCEPT_ALL,
+	BT_RECORD_RESPONSE_MAX,
+} bt_record_response_t;
+
+struct bt_recorder_entry {
+	uint32_t seq;
+	uint16_t event_type;	/* bt_popup_event_type_t */
+	uint8_t reason;		/* bt_record_reason_t */
+	uint8_t response;	/* bt_record_response_t */
+	uint32_t device_hash;	/* bt_recorder_hash() of the device id */
+	uint32_t shown_us;	/* From arrival, or BT_RECORDER_NO_TIME */
+	uint32_t answered_us;
+	uint32_t replied_us;
+	int64_t arrival_us;	/* Wall clock */
+};
+
+/* Latencies in power of two buckets, bucket i up to 2^i usec */
+struct bt_histogram {
+	uint32_t buckets[BT_HIST_BUCKETS];
+	uint32_t count;
+	uint32_t reserved;
+	int64_t total_us;
+	int64_t max_us;
+};
+
+/* Latencies and outcomes of one event type, see GetStats */
+struct bt_event_stats {
+	uint32_t count;
+	uint32_t accept;	/* Accept and accept all */
+	uint32_t reject;
+	uint32_t cancel;
+	uint32_t timeout;	/* Timed out, or expired before shown */
+	uint32_t create_failed;	/* syspopup_create */
+	struct bt_histogram visible;	/* Request to first frame */
+	struct bt_histogram decision;	/* First frame to the user's answer */
+	struct bt_histogram reply;	/* Reply sent to acked by the agent */
+};
+
+struct bt_recorder_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t entry_size;
+	uint32_t capacity;
+	uint32_t head;		/* Entries ever written */
+};
+
+struct bt_recorder_file {
+	struct bt_recorder_header header;
+	struct bt_recorder_entry entries[BT_RECORDER_CAPACITY];
+	struct bt_event_stats stats[BT_RECORDER_EVENT_MAX];
+};
+
+int bt_recorder_open(const char *path);
+
+void bt_recorder_close(void);
+
+void bt_recorder_append(struct bt_recorder_entry *entry);
+
+struct bt_event_stats *bt_recorder_stats(uint16_t event_type);
+
+void bt_recorder_reset_stats(void);
+
+void bt_histogram_add(struct bt_histogram *hist, int64_t us);
+
+int64_t bt_histogram_percentile(const struct bt_histogram *hist, int percent);
+
+uint32_t bt_recorder_hash(const char *str);
+
+int bt_recorder_valid(const struct bt_recorder_file *file, size_t size);
+
+const char *bt_recorder_reason_name(uint8_t reason);
+
+const char *bt_recorder_response_name(uint8_t response);
+
+#endif				/* __DEF_BT_RECORDER_H_ */
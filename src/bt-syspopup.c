@@ -15,6 +15,8 @@
  */
 
 #include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
 #include <pmapi.h>
 #include <appcore-efl.h>
 #include <Ecore_X.h>
@@ -22,13 +24,25 @@
 #include <vconf.h>
 #include <vconf-keys.h>
 #include <syspopup.h>
-#include <E_DBus.h>
+#include <dbus/dbus-glib-lowlevel.h>
 #include <aul.h>
+#include <notification.h>
+#if defined(BT_MEM_ACCOUNTING) || defined(BT_BENCHMARK)
+#include <malloc.h>
+#endif
 
 #include "bt-syspopup.h"
+#include "bt-policy.h"
+#ifdef BT_PROVISIONING
+#include "bt-provision.h"
+#endif
 
 static void __bluetooth_delete_input_view(struct bt_popup_appdata *ad);
 static void __bluetooth_win_del(void *data);
+static void __bluetooth_account_request(struct bt_popup_request *req);
+static void __bluetooth_register_stats(struct bt_popup_appdata *ad);
+static gboolean __bluetooth_show_next_request(struct bt_popup_appdata *ad);
+static int __bluetooth_reset(bundle *b, void *data);
 
 static int __bluetooth_term(bundle *b, void *data)
 {
@@ -47,6 +61,339 @@ syspopup_handler handler = {
 	.def_timeout_fn = __bluetooth_timeout
 };
 
+/* Text domain and message ID of each bt_str_id_t */
+static const struct {
+	const char *domain;
+	const char *msgid;
+} bt_str_catalog[BT_STR_ID_MAX] = {
+	[BT_STR_ID_ENTER_PIN] = { BT_COMMON_PKG,
+		"IDS_BT_HEADER_ENTERPIN" },
+	[BT_STR_ID_ALLOW_PS_TO_CONNECT_Q] = { BT_COMMON_PKG,
+		"IDS_BT_POP_ALLOW_PS_TO_CONNECT_Q" },
+	[BT_STR_ID_RECEIVE_PS_FROM_PS_Q] = { BT_COMMON_PKG,
+		"IDS_BT_POP_RECEIVE_PS_FROM_PS_Q" },
+	[BT_STR_ID_PASSKEY_MATCH_Q] = { BT_COMMON_PKG,
+		"IDS_BT_POP_MATCH_PASSKEYS_ON_PS_Q" },
+	[BT_STR_ID_OVERWRITE_FILE_Q] = { BT_COMMON_PKG,
+		"IDS_BT_POP_PS_ALREADY_EXISTS_OVERWRITE_Q" },
+	[BT_STR_ID_ENTER_PS_ON_PS_TO_PAIR] = { BT_COMMON_PKG,
+		"IDS_BT_BODY_ENTER_P1SS_ON_P2SS_TO_PAIR_THEN_TAP_RETURN_OR_ENTER" },
+	[BT_STR_ID_EXCHANGE_OBJECT_WITH_PS_Q] = { BT_COMMON_PKG,
+		"IDS_BT_POP_EXCHANGEOBJECT" },
+	[BT_STR_ID_BLUETOOTH_PAIRING_REQUEST] = { BT_COMMON_PKG,
+		"IDS_BT_HEADER_BLUETOOTH_PAIRING_REQUEST" },
+	[BT_STR_ID_ENTER_PIN_TO_PAIR] = { BT_COMMON_PKG,
+		"IDS_BT_POP_ENTER_PIN_TO_PAIR_WITH_PS_HTRY_0000_OR_1234" },
+	[BT_STR_ID_SHOW_PASSWORD] = { BT_COMMON_PKG,
+		"IDS_BT_BODY_SHOW_PASSWORD" },
+	[BT_STR_ID_CONFIRM_PASSKEY_PS_TO_PAIR_WITH_PS] = { BT_COMMON_PKG,
+		"IDS_BT_POP_CONFIRM_PASSKEY_IS_P2SS_TO_PAIR_WITH_P1SS" },
+	[BT_STR_ID_ACCEPT_ALL] = { PACKAGE,
+		"IDS_BT_BUTTON_ACCEPT_ALL" },
+	[BT_STR_ID_APPLY_TO_ALL] = { PACKAGE,
+		"IDS_BT_BUTTON_APPLY_TO_ALL" },
+	[BT_STR_ID_OK] = { "sys_string",
+		"IDS_COM_SK_OK" },
+	[BT_STR_ID_YES] = { "sys_string",
+		"IDS_COM_SK_YES" },
+	[BT_STR_ID_NO] = { "sys_string",
+		"IDS_COM_SK_NO" },
+	[BT_STR_ID_DONE] = { "sys_string",
+		"IDS_COM_SK_DONE" },
+	[BT_STR_ID_CANCEL] = { "sys_string",
+		"IDS_COM_SK_CANCEL" },
+};
+
+/* Translated strings, used through the BT_STR_* defines */
+static char *bt_str[BT_STR_ID_MAX];
+
+static void __bluetooth_free_strings(void)
+{
+	int i;
+
+	for (i = 0; i < BT_STR_ID_MAX; i++) {
+		g_free(bt_str[i]);
+		bt_str[i] = NULL;
+	}
+}
+
+/* Resolve the whole catalog for the current language */
+static void __bluetooth_load_strings(void)
+{
+	int i;
+
+	__bluetooth_free_strings();
+
+	for (i = 0; i < BT_STR_ID_MAX; i++)
+		bt_str[i] = g_strdup(dgettext(bt_str_catalog[i].domain,
+					      bt_str_catalog[i].msgid));
+}
+
+static int __bluetooth_lang_changed_cb(void *data)
+{
+	bt_log_print(BT_POPUP, "Language changed, reload strings");
+
+	/* The popup shown now keeps its text, the next one is translated */
+	__bluetooth_load_strings();
+
+	return 0;
+}
+
+/* Resident set size of this process in KB, -1 on failure */
+static long __bluetooth_get_rss_kb(void)
+{
+	FILE *fp;
+	long size = 0;
+	long rss = -1;
+
+	fp = fopen("/proc/self/statm", "r");
+	if (fp == NULL)
+		return -1;
+
+	if (fscanf(fp, "%ld %ld", &size, &rss) != 2)
+		rss = -1;
+
+	fclose(fp);
+
+	if (rss < 0)
+		return -1;
+
+	return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static const char *bt_trace_phase_name[BT_TRACE_PHASE_MAX] = {
+	[BT_TRACE_MAIN] = "main",
+	[BT_TRACE_CREATE_START] = "create_start",
+	[BT_TRACE_I18N] = "i18n",
+	[BT_TRACE_CREATE_END] = "create_end",
+	[BT_TRACE_SESSION_INIT] = "session_init",
+	[BT_TRACE_RESET] = "reset",
+	[BT_TRACE_SYSPOPUP_CREATE] = "syspopup_create",
+	[BT_TRACE_LAUNCH_HANDLER] = "launch_handler",
+	[BT_TRACE_POPUP_SHOW] = "popup_show",
+	[BT_TRACE_FIRST_FRAME] = "first_frame",
+	[BT_TRACE_USER_RESPONSE] = "user_response",
+	[BT_TRACE_REPLY] = "reply",
+};
+
+static const char *bt_template_origin_name[] = {
+	[BT_TEMPLATE_BUILT] = "built",
+	[BT_TEMPLATE_PREWARMED] = "prewarmed",
+	[BT_TEMPLATE_REUSED] = "reused",
+};
+
+/* Stamp a launch phase of the process, or of the request shown now */
+static void __bluetooth_trace_mark(struct bt_popup_appdata *ad,
+				   bt_trace_phase_t phase)
+{
+	gint64 *trace;
+
+	if (phase < BT_TRACE_RESET)
+		trace = ad->launch_trace;
+	else if (ad->request)
+		trace = ad->request->trace;
+	else
+		return;
+
+	/* Keep the first stamp, e.g. of several clicks */
+	if (trace[phase] == 0)
+		trace[phase] = g_get_monotonic_time();
+}
+
+#ifdef BT_LAUNCH_TRACE
+/* One JSON object per line. Timestamps are monotonic usec, phases which
+   did not happen are left out. */
+static void __bluetooth_trace_append(struct bt_popup_appdata *ad,
+				     struct bt_popup_request *req)
+{
+	GString *line;
+	FILE *fp;
+	int i;
+
+	line = g_string_new(NULL);
+	g_string_append_printf(line, "{\"pid\":%d,\"event\":\"%s\","
+			       "\"cold\":%s", getpid(), req->desc->name,
+			       ad->launch_traced ? "false" : "true");
+
+	/* The process phases are reported with the first request only */
+	if (!ad->launch_traced) {
+		for (i = 0; i < BT_TRACE_RESET; i++) {
+			if (ad->launch_trace[i] == 0)
+				continue;
+			g_string_append_printf(line, ",\"%s\":%lld",
+					       bt_trace_phase_name[i],
+					       (long long)ad->launch_trace[i]);
+		}
+	}
+
+	for (i = BT_TRACE_RESET; i < BT_TRACE_PHASE_MAX; i++) {
+		if (req->trace[i] == 0)
+			continue;
+		g_string_append_printf(line, ",\"%s\":%lld",
+				       bt_trace_phase_name[i],
+				       (long long)req->trace[i]);
+	}
+
+	g_string_append_printf(line, ",\"template\":\"%s\"}",
+			       bt_template_origin_name[req->origin]);
+
+	fp = fopen(BT_TRACE_FILE, "a");
+	if (fp) {
+		fprintf(fp, "%s\n", line->str);
+		fclose(fp);
+	} else {
+		bt_log_print(BT_POPUP, "Fail to open %s", BT_TRACE_FILE);
+	}
+
+	g_string_free(line, TRUE);
+}
+#endif
+
+static void __bluetooth_trace_write(struct bt_popup_appdata *ad,
+				    struct bt_popup_request *req)
+{
+	gint64 start;
+
+	start = ad->launch_traced ? req->trace[BT_TRACE_RESET] :
+				    ad->launch_trace[BT_TRACE_MAIN];
+	if (req->trace[BT_TRACE_POPUP_SHOW] && start)
+		bt_log_print(BT_POPUP, "%s shown in %lld us (%s)",
+			     req->desc->name,
+			     (long long)(req->trace[BT_TRACE_POPUP_SHOW] -
+					 start),
+			     ad->launch_traced ? "warm" : "cold");
+
+	/* What prewarming saves: compare the prewarmed and built lines */
+	if (req->trace[BT_TRACE_FIRST_FRAME])
+		bt_log_print(BT_POPUP, "%s first frame in %lld us, %s template",
+			     req->desc->name,
+			     (long long)(req->trace[BT_TRACE_FIRST_FRAME] -
+					 req->trace[BT_TRACE_RESET]),
+			     bt_template_origin_name[req->origin]);
+
+#ifdef BT_LAUNCH_TRACE
+	__bluetooth_trace_append(ad, req);
+#endif
+
+	ad->launch_traced = EINA_TRUE;
+}
+
+/* A long lived process must settle after the first requests of each type.
+   Log whenever a closed popup leaves the process bigger than ever. The soak
+   run of bench/bt-bench.c fails on the growth of each type. */
+static void __bluetooth_check_growth(struct bt_popup_appdata *ad,
+				     struct bt_popup_request *req)
+{
+	long rss = __bluetooth_get_rss_kb();
+
+	if (rss <= ad->rss_peak)
+		return;
+
+	if (ad->rss_peak > 0)
+		bt_log_print(BT_POPUP, "RSS grew %ld KB to %ld KB after %s, "
+			     "objects created[%d]", rss - ad->rss_peak, rss,
+			     req->desc->name, ad->obj_created);
+
+	ad->rss_peak = rss;
+}
+
+#ifdef BT_MEM_ACCOUNTING
+static void __bluetooth_mem_account(struct bt_popup_appdata *ad,
+				    gboolean teardown);
+#endif
+
+#ifdef BT_BENCHMARK
+/* Benchmark build: press the first button of each popup as soon as it is
+   drawn, with BT_BENCH_CODE typed into the input view */
+static void __bluetooth_bench_click_cb(void *data)
+{
+	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
+	struct bt_popup_template *tpl = NULL;
+	int i;
+
+	/* Answered meanwhile, or the next request is not drawn yet */
+	if (ad->request == NULL ||
+	    ad->request->trace[BT_TRACE_FIRST_FRAME] == 0 ||
+	    ad->request->trace[BT_TRACE_USER_RESPONSE] != 0)
+		return;
+
+	for (i = 0; i < BT_POPUP_LAYOUT_MAX; i++) {
+		if (ad->templates[i].popup && ad->templates[i].popup == ad->popup)
+			tpl = &ad->templates[i];
+	}
+
+	if (tpl == NULL || tpl->btn1 == NULL) {
+		bt_log_print(BT_POPUP, "No button to press for [0x%04x]",
+			     ad->event_type);
+		return;
+	}
+
+	if (tpl->entry)
+		elm_entry_entry_set(tpl->entry, BT_BENCH_CODE);
+
+	evas_object_smart_callback_call(tpl->btn1, "clicked", NULL);
+}
+#endif
+
+static void __bluetooth_render_post_cb(void *data, Evas *e, void *event_info)
+{
+	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
+
+	evas_event_callback_del(e, EVAS_CALLBACK_RENDER_POST,
+				__bluetooth_render_post_cb);
+	ad->frame_pending = EINA_FALSE;
+
+	__bluetooth_trace_mark(ad, BT_TRACE_FIRST_FRAME);
+
+#ifdef BT_MEM_ACCOUNTING
+	/* Off the way to the first frame, and with its buffers allocated */
+	__bluetooth_mem_account(ad, FALSE);
+#endif
+
+#ifdef BT_BENCHMARK
+	/* Not from the render callbacks Evas is walking */
+	ecore_job_add(__bluetooth_bench_click_cb, ad);
+#endif
+}
+
+/* Why the request ends, for the flight recorder */
+static void __bluetooth_request_outcome(struct bt_popup_request *req,
+					bt_record_reason_t reason,
+					bt_record_response_t response)
+{
+	if (req == NULL || req->reason != BT_RECORD_UNANSWERED)
+		return;
+
+	req->reason = reason;
+	req->response = response;
+
+	/* Answered without the user, the reply goes out right away */
+	if (reason != BT_RECORD_USER && response != BT_RECORD_RESPONSE_NONE &&
+	    req->trace[BT_TRACE_REPLY] == 0)
+		req->trace[BT_TRACE_REPLY] = g_get_monotonic_time();
+}
+
+static const bt_record_response_t bt_btn_record_response[] = {
+	[BT_BTN_ACCEPT] = BT_RECORD_RESPONSE_ACCEPT,
+	[BT_BTN_REJECT] = BT_RECORD_RESPONSE_REJECT,
+	[BT_BTN_ACCEPT_ALL] = BT_RECORD_RESPONSE_ACCEPT_ALL,
+	[BT_BTN_CANCEL] = BT_RECORD_RESPONSE_CANCEL,
+};
+
+static void __bluetooth_btn_trace_cb(void *data, Evas_Object *obj,
+				     void *event_info)
+{
+	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
+	bt_btn_response_t response;
+
+	__bluetooth_trace_mark(ad, BT_TRACE_USER_RESPONSE);
+
+	response = GPOINTER_TO_INT(evas_object_data_get(obj,
+							BT_BTN_RESPONSE_KEY));
+	__bluetooth_request_outcome(ad->request, BT_RECORD_USER,
+				    bt_btn_record_response[response]);
+}
+
 /* Cleanup objects to avoid mem-leak */
 static void __bluetooth_cleanup(struct bt_popup_appdata *ad)
 {
@@ -61,153 +408,964 @@ static void __bluetooth_cleanup(struct bt_popup_appdata *ad)
 
 	ad->popup = NULL;
 	ad->win_main = NULL;
+	ad->frame_pending = EINA_FALSE;
+
+	/* Templates were children of the deleted window */
+	memset(ad->templates, 0x0, sizeof(ad->templates));
+	ad->imf_context = NULL;
 }
 
-static void __bluetooth_parse_event(struct bt_popup_appdata *ad, const char *event_type)
-{
-	if (!strcasecmp(event_type, "pin-request"))
-		ad->event_type = BT_EVENT_PIN_REQUEST;
-	else if (!strcasecmp(event_type, "passkey-confirm-request"))
-		ad->event_type = BT_EVENT_PASSKEY_CONFIRM_REQUEST;
-	else if (!strcasecmp(event_type, "passkey-request"))
-		ad->event_type = BT_EVENT_PASSKEY_REQUEST;
-	else if (!strcasecmp(event_type, "authorize-request"))
-		ad->event_type = BT_EVENT_AUTHORIZE_REQUEST;
-	else if (!strcasecmp(event_type, "app-confirm-request"))
-		ad->event_type = BT_EVENT_APP_CONFIRM_REQUEST;
-	else if (!strcasecmp(event_type, "push-authorize-request"))
-		ad->event_type = BT_EVENT_PUSH_AUTHORIZE_REQUEST;
-	else if (!strcasecmp(event_type, "confirm-overwrite-request"))
-		ad->event_type = BT_EVENT_CONFIRM_OVERWRITE_REQUEST;
-	else if (!strcasecmp(event_type, "keyboard-passkey-request"))
-		ad->event_type = BT_EVENT_KEYBOARD_PASSKEY_REQUEST;
-	else if (!strcasecmp(event_type, "bt-information"))
-		ad->event_type = BT_EVENT_INFORMATION;
-	else if (!strcasecmp(event_type, "exchange-request"))
-		ad->event_type = BT_EVENT_EXCHANGE_REQUEST;
-	else
-		ad->event_type = 0x0000;
+static void __bluetooth_flush_replies(struct bt_popup_appdata *ad);
+
+static void __bluetooth_exit(struct bt_popup_appdata *ad)
+{
+	if (ad)
+		__bluetooth_flush_replies(ad);
+
+	__bluetooth_cleanup(ad);
+
+	elm_exit();
+}
+
+static int __bluetooth_idle_timeout_cb(void *data)
+{
+	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
+
+	if (ad == NULL)
+		return 0;
+
+	bt_log_print(BT_POPUP, "No request for %d sec, exiting",
+		     BT_RESIDENT_IDLE_TIMEOUT);
+
+	ad->idle_timer = NULL;
+	__bluetooth_exit(ad);
+
+	return 0;
+}
+
+static void __bluetooth_hide_popup(struct bt_popup_appdata *ad)
+{
+	struct bt_popup_template *input = &ad->templates[BT_POPUP_LAYOUT_INPUT];
+
+	if (ad->timer) {
+		ecore_timer_del(ad->timer);
+		ad->timer = NULL;
+	}
+
+	/* Also on timeout or END key, not only from the buttons */
+	if (ad->entry)
+		__bluetooth_delete_input_view(ad);
+
+	/* The elm_popup of the input view is a notify object, hiding its
+	   conformant does not reliably hide it */
+	if (ad->popup && ad->popup == input->popup)
+		evas_object_hide(input->dialog);
+
+	/* The popup belongs to a cached template, keep it for reuse */
+	if (ad->popup)
+		evas_object_hide(ad->popup);
+
+	ad->popup = NULL;
+	ad->entry = NULL;
+	ad->editfield = NULL;
+	ad->edit_field_save_btn = NULL;
+	ad->event_type = 0x0000;
+}
+
+/* Resident mode: drop the popup, but keep win_main and the D-Bus proxies
+   for the next request */
+static void __bluetooth_hide(struct bt_popup_appdata *ad)
+{
+	if (ad == NULL)
 		return;
+
+	__bluetooth_hide_popup(ad);
+
+	if (ad->win_main) {
+		elm_win_conformant_set(ad->win_main, EINA_FALSE);
+		evas_object_hide(ad->win_main);
+	}
+
+	if (ad->idle_timer)
+		ecore_timer_del(ad->idle_timer);
+
+	ad->idle_timer = ecore_timer_add(BT_RESIDENT_IDLE_TIMEOUT,
+					 (Ecore_Task_Cb)
+					 __bluetooth_idle_timeout_cb,
+					 ad);
+
+	/* Also for the processes which never drew a popup */
+	__bluetooth_register_stats(ad);
 }
 
-static void __bluetooth_request_to_cancel(void)
+static void __bluetooth_decode_bundle_cb(const char *key, const char *val,
+					void *data)
 {
-	/* To be implement it */
+	struct bt_popup_request_data *req_data = data;
+
+	if (key == NULL || val == NULL)
+		return;
+
+	if (!strcmp(key, "device-name")) {
+		req_data->device_name = val;
+		req_data->keys |= BT_BUNDLE_KEY_DEVICE_NAME;
+	} else if (!strcmp(key, "device-address")) {
+		req_data->device_address = val;
+		req_data->keys |= BT_BUNDLE_KEY_DEVICE_ADDRESS;
+	} else if (!strcmp(key, "passkey")) {
+		req_data->passkey = val;
+		req_data->keys |= BT_BUNDLE_KEY_PASSKEY;
+	} else if (!strcmp(key, "file")) {
+		req_data->file = val;
+		req_data->keys |= BT_BUNDLE_KEY_FILE;
+	} else if (!strcmp(key, "title")) {
+		req_data->title = val;
+		req_data->keys |= BT_BUNDLE_KEY_TITLE;
+	} else if (!strcmp(key, "type")) {
+		req_data->type = val;
+		req_data->keys |= BT_BUNDLE_KEY_TYPE;
+	} else if (!strcmp(key, "deadline")) {
+		req_data->deadline = val;
+		req_data->keys |= BT_BUNDLE_KEY_DEADLINE;
+	} else if (!strcmp(key, "service")) {
+		req_data->service = val;
+		req_data->keys |= BT_BUNDLE_KEY_SERVICE;
+	}
 }
 
-static void __bluetooth_remove_all_event(struct bt_popup_appdata *ad)
+/* The agent may send its own absolute deadline, in CLOCK_MONOTONIC msec.
+   Time spent launching the popup then counts against the request. */
+static void __bluetooth_apply_agent_deadline(struct bt_popup_request *req)
 {
-	switch (ad->event_type) {
-	case BT_EVENT_PIN_REQUEST:
+	char *end = NULL;
+	long long deadline_ms;
+	gint64 now_ms;
+	double remaining;
 
-		dbus_g_proxy_call_no_reply(ad->agent_proxy,
-					   "ReplyPinCode",
-					   G_TYPE_UINT, BT_AGENT_CANCEL,
-					   G_TYPE_STRING, "", G_TYPE_INVALID,
-					   G_TYPE_INVALID);
+	/* Display only requests wait for no answer and never expire */
+	if (req->data.deadline == NULL || req->timeout == 0)
+		return;
 
-		break;
+	errno = 0;
+	deadline_ms = strtoll(req->data.deadline, &end, 10);
+	if (errno != 0 || end == req->data.deadline || *end != '\0' ||
+	    deadline_ms <= 0) {
+		bt_log_print(BT_POPUP, "Invalid deadline [%s]",
+			     req->data.deadline);
+		return;
+	}
 
+	/* Later than our own timeout, it would not shorten it. Checked in
+	   msec, so a huge value can not overflow. */
+	now_ms = g_get_monotonic_time() / 1000;
+	if (deadline_ms > now_ms + (gint64)req->timeout * 1000)
+		return;
 
-	case BT_EVENT_KEYBOARD_PASSKEY_REQUEST:
+	remaining = (deadline_ms - now_ms) / 1e3;
 
-		__bluetooth_request_to_cancel();
+	/* ecore_time_get() may have another origin, keep the distance only */
+	if (req->arrival + remaining < req->deadline)
+		req->deadline = req->arrival + remaining;
 
-		break;
+	bt_log_print(BT_POPUP, "Agent deadline in %.3f sec", remaining);
+}
 
-	case BT_EVENT_PASSKEY_CONFIRM_REQUEST:
+static struct bt_popup_request *__bluetooth_request_new(bundle *b,
+					const struct bt_event_desc *desc)
+{
+	struct bt_popup_request *req;
 
-		dbus_g_proxy_call_no_reply(ad->agent_proxy,
-					   "ReplyConfirmation",
-					   G_TYPE_UINT, BT_AGENT_CANCEL,
-					   G_TYPE_INVALID, G_TYPE_INVALID);
+	req = calloc(1, sizeof(struct bt_popup_request));
+	if (req == NULL)
+		return NULL;
 
-		break;
+	req->b = bundle_dup(b);
+	if (req->b == NULL) {
+		free(req);
+		return NULL;
+	}
 
-	case BT_EVENT_PASSKEY_REQUEST:
+	/* One pass over the bundle, the renderers only read req->data */
+	bundle_iterate(req->b, __bluetooth_decode_bundle_cb, &req->data);
 
-		dbus_g_proxy_call_no_reply(ad->agent_proxy,
-					   "ReplyPassKey",
-					   G_TYPE_UINT, BT_AGENT_CANCEL,
-					   G_TYPE_STRING, "", G_TYPE_INVALID,
-					   G_TYPE_INVALID);
+	req->desc = desc;
+	req->event_type = desc->event_type;
+	req->priority = desc->priority;
+	req->timeout = desc->timeout;
+	req->arrival = ecore_time_get();
+	req->deadline = req->arrival + desc->timeout;
 
-		break;
+	__bluetooth_apply_agent_deadline(req);
 
-	case BT_EVENT_PASSKEY_DISPLAY_REQUEST:
-		/* Nothing to do */
-		break;
+	return req;
+}
+
+/* Address when the agent provides it, device name otherwise */
+static const char *__bluetooth_get_device_id(struct bt_popup_request *req)
+{
+	const char *device;
 
-	case BT_EVENT_AUTHORIZE_REQUEST:
+	device = req->data.device_address;
+	if (device == NULL)
+		device = req->data.device_name;
 
-		dbus_g_proxy_call_no_reply(ad->agent_proxy,
-					   "ReplyAuthorize",
-					   G_TYPE_UINT, BT_AGENT_CANCEL,
-					   G_TYPE_INVALID, G_TYPE_INVALID);
+	return device ? device : "";
+}
 
-		break;
+static uint32_t __bluetooth_record_delta(struct bt_popup_request *req,
+					 bt_trace_phase_t phase)
+{
+	gint64 delta;
+
+	if (req->trace[phase] == 0)
+		return BT_RECORDER_NO_TIME;
+
+	delta = req->trace[phase] - req->trace[BT_TRACE_RESET];
+	if (delta < 0)
+		delta = 0;
+
+	return MIN(delta, BT_RECORDER_NO_TIME - 1);
+}
+
+/* Map the recorder on first use. Without the file, the entries and
+   statistics are still kept for the life of the process. */
+static void __bluetooth_open_recorder(void)
+{
+	static gboolean opened;
+	int ret;
+
+	if (opened)
+		return;
+
+	opened = TRUE;
+	ret = bt_recorder_open(BT_RECORDER_FILE);
+	if (ret < 0)
+		bt_log_print(BT_POPUP, "Fail to open %s [%d]",
+			     BT_RECORDER_FILE, ret);
+}
+
+/* One binary entry per request, no formatting on this path */
+static void __bluetooth_record_request(struct bt_popup_request *req)
+{
+	struct bt_recorder_entry entry;
+	gint64 age;
+
+	__bluetooth_open_recorder();
+
+	age = g_get_monotonic_time() - req->trace[BT_TRACE_RESET];
+
+	memset(&entry, 0x0, sizeof(entry));
+	entry.event_type = req->event_type;
+	entry.reason = req->reason;
+	entry.response = req->response;
+	entry.device_hash = bt_recorder_hash(__bluetooth_get_device_id(req));
+	entry.shown_us = __bluetooth_record_delta(req, BT_TRACE_POPUP_SHOW);
+	entry.answered_us = __bluetooth_record_delta(req,
+						BT_TRACE_USER_RESPONSE);
+	entry.replied_us = __bluetooth_record_delta(req, BT_TRACE_REPLY);
+	entry.arrival_us = g_get_real_time() - age;
+
+	bt_recorder_append(&entry);
+}
+
+static void __bluetooth_request_free(struct bt_popup_request *req)
+{
+	if (req == NULL)
+		return;
+
+	__bluetooth_record_request(req);
+	__bluetooth_account_request(req);
+
+	if (req->b)
+		bundle_free(req->b);
+
+	free(req);
+}
+
+static int __bluetooth_request_enqueue(struct bt_popup_appdata *ad,
+				       struct bt_popup_request *req)
+{
+	if (ad->queue_len >= BT_REQUEST_QUEUE_MAX)
+		return -1;
+
+	ad->queue[ad->queue_len++] = req;
 
-	case BT_EVENT_APP_CONFIRM_REQUEST:
-		{
-			DBusMessage *msg = NULL;
-			int response = 2;
+	return 0;
+}
+
+/* Most urgent request first, arrival order within the same priority */
+static struct bt_popup_request *__bluetooth_request_dequeue(
+					struct bt_popup_appdata *ad)
+{
+	struct bt_popup_request *req;
+	int best = -1;
+	int i;
+
+	for (i = 0; i < ad->queue_len; i++) {
+		if (best < 0 ||
+		    ad->queue[i]->priority < ad->queue[best]->priority)
+			best = i;
+	}
+
+	if (best < 0)
+		return NULL;
+
+	req = ad->queue[best];
+	memmove(&ad->queue[best], &ad->queue[best + 1],
+		(ad->queue_len - best - 1) * sizeof(ad->queue[0]));
+	ad->queue_len--;
+
+	return req;
+}
+
+static DBusGConnection *__bluetooth_get_connection(struct bt_popup_appdata *ad)
+{
+	GError *err = NULL;
+	gint64 start;
+
+	if (ad->conn)
+		return ad->conn;
+
+	start = g_get_monotonic_time();
+
+	ad->conn = dbus_g_bus_get(DBUS_BUS_SYSTEM, &err);
+	if (!ad->conn) {
+		bt_log_print(BT_POPUP,
+			     "ERROR: Can't get on system bus [%s]",
+			     err->message);
+		g_error_free(err);
+		return NULL;
+	}
 
-			msg = dbus_message_new_signal(
-					BT_SYS_POPUP_IPC_RESPONSE_OBJECT,
-					BT_SYS_POPUP_INTERFACE,
-					BT_SYS_POPUP_METHOD_RESPONSE);
+	__bluetooth_trace_mark(ad, BT_TRACE_SESSION_INIT);
 
-			/* For timeout rejection is sent to  be handled in
-			   application */
-			response = 1;
+	bt_log_print(BT_POPUP, "System bus in %lld us, RSS %ld KB",
+		     (long long)(g_get_monotonic_time() - start),
+		     __bluetooth_get_rss_kb());
 
-			dbus_message_append_args(msg,
-				 DBUS_TYPE_INT32, &response,
-				 DBUS_TYPE_INVALID);
+	return ad->conn;
+}
+
+#define BT_PROXY_MASK(type) (1 << (type))
 
-			e_dbus_message_send(ad->EDBusHandle,
-				msg, NULL, -1, NULL);
+/* proxies is a mask of BT_PROXY_MASK() */
+static gboolean __bluetooth_desc_uses_proxy(const struct bt_event_desc *desc,
+					    unsigned int proxies)
+{
+	return (desc->accept.kind == BT_REPLY_KIND_METHOD &&
+		(proxies & BT_PROXY_MASK(desc->accept.proxy))) ||
+	       (desc->cancel.kind == BT_REPLY_KIND_METHOD &&
+		(proxies & BT_PROXY_MASK(desc->cancel.proxy)));
+}
 
-			dbus_message_unref(msg);
+/* Drop requests of an agent which no longer waits for them, the shown
+   one (else the oldest queued one) or all of them. Nothing is replied,
+   the agent has already given up. The queued requests go first, so the
+   shown one is closed once, with nothing left to show in its place. */
+static void __bluetooth_drop_requests(struct bt_popup_appdata *ad,
+				      unsigned int proxies, gboolean all)
+{
+	struct bt_popup_request *req;
+	gboolean shown;
+	int i = 0;
+
+	shown = ad->request &&
+		__bluetooth_desc_uses_proxy(ad->request->desc, proxies);
+
+	while ((all || !shown) && i < ad->queue_len) {
+		req = ad->queue[i];
+		if (!__bluetooth_desc_uses_proxy(req->desc, proxies)) {
+			i++;
+			continue;
 		}
-		break;
 
-	case BT_EVENT_PUSH_AUTHORIZE_REQUEST:
-	case BT_EVENT_EXCHANGE_REQUEST:
+		memmove(&ad->queue[i], &ad->queue[i + 1],
+			(ad->queue_len - i - 1) * sizeof(ad->queue[0]));
+		ad->queue_len--;
+		__bluetooth_request_outcome(req, BT_RECORD_AGENT_CANCEL,
+					    BT_RECORD_RESPONSE_NONE);
+		__bluetooth_request_free(req);
 
-		dbus_g_proxy_call_no_reply(ad->obex_proxy,
-					   "ReplyAuthorize",
-					   G_TYPE_UINT, BT_AGENT_CANCEL,
-					   G_TYPE_INVALID, G_TYPE_INVALID);
+		if (!all)
+			return;
+	}
 
-		break;
+	if (shown) {
+		bt_log_print(BT_POPUP, "%s cancelled by the agent",
+			     ad->request->desc->name);
+		__bluetooth_request_outcome(ad->request,
+					    BT_RECORD_AGENT_CANCEL,
+					    BT_RECORD_RESPONSE_NONE);
+		__bluetooth_win_del(ad);
+	}
+}
+
+static void __bluetooth_agent_cancel_cb(DBusGProxy *proxy, gpointer data)
+{
+	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
+
+	__bluetooth_drop_requests(ad, BT_PROXY_MASK((proxy == ad->obex_proxy) ?
+				  BT_PROXY_OBEX : BT_PROXY_AGENT), FALSE);
+}
+
+static void __bluetooth_agent_release_cb(DBusGProxy *proxy, gpointer data)
+{
+	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
+
+	__bluetooth_drop_requests(ad, BT_PROXY_MASK((proxy == ad->obex_proxy) ?
+				  BT_PROXY_OBEX : BT_PROXY_AGENT), TRUE);
+}
+
+static void __bluetooth_name_owner_changed_cb(DBusGProxy *proxy,
+					      const char *name,
+					      const char *old_owner,
+					      const char *new_owner,
+					      gpointer data)
+{
+	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
+
+	if (name == NULL || strcmp(name, BT_AGENT_SERVICE) != 0 ||
+	    (new_owner && *new_owner != '\0'))
+		return;
+
+	bt_log_print(BT_POPUP, "%s left the bus", BT_AGENT_SERVICE);
+
+	__bluetooth_drop_requests(ad, BT_PROXY_MASK(BT_PROXY_OBEX) |
+				  BT_PROXY_MASK(BT_PROXY_AGENT), TRUE);
+}
 
-	case BT_EVENT_CONFIRM_OVERWRITE_REQUEST:
+/* Learn about a cancelled request or a vanished agent right away, not
+   when the popup times out */
+static void __bluetooth_watch_agent(struct bt_popup_appdata *ad,
+				    DBusGProxy *proxy)
+{
+	dbus_g_proxy_add_signal(proxy, BT_AGENT_SIGNAL_CANCEL, G_TYPE_INVALID);
+	dbus_g_proxy_connect_signal(proxy, BT_AGENT_SIGNAL_CANCEL,
+				    G_CALLBACK(__bluetooth_agent_cancel_cb),
+				    ad, NULL);
+
+	dbus_g_proxy_add_signal(proxy, BT_AGENT_SIGNAL_RELEASE,
+				G_TYPE_INVALID);
+	dbus_g_proxy_connect_signal(proxy, BT_AGENT_SIGNAL_RELEASE,
+				    G_CALLBACK(__bluetooth_agent_release_cb),
+				    ad, NULL);
+
+	if (ad->bus_proxy)
+		return;
+
+	ad->bus_proxy = dbus_g_proxy_new_for_name(ad->conn, DBUS_SERVICE_DBUS,
+						  DBUS_PATH_DBUS,
+						  DBUS_INTERFACE_DBUS);
+	if (ad->bus_proxy == NULL)
+		return;
+
+	dbus_g_proxy_add_signal(ad->bus_proxy, "NameOwnerChanged",
+				G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING,
+				G_TYPE_INVALID);
+	dbus_g_proxy_connect_signal(ad->bus_proxy, "NameOwnerChanged",
+				G_CALLBACK(__bluetooth_name_owner_changed_cb),
+				ad, NULL);
+}
+
+static DBusGProxy *__bluetooth_get_proxy(struct bt_popup_appdata *ad,
+					 bt_proxy_type_t type)
+{
+	DBusGConnection *conn;
+	DBusGProxy **proxy;
+	gint64 start;
 
-		dbus_g_proxy_call_no_reply(ad->obex_proxy,
-					   "ReplyOverwrite",
-					   G_TYPE_UINT, BT_AGENT_CANCEL,
-					   G_TYPE_INVALID, G_TYPE_INVALID);
+	proxy = (type == BT_PROXY_OBEX) ? &ad->obex_proxy : &ad->agent_proxy;
+	if (*proxy)
+		return *proxy;
 
+	conn = __bluetooth_get_connection(ad);
+	if (conn == NULL)
+		return NULL;
+
+	start = g_get_monotonic_time();
+
+	if (type == BT_PROXY_OBEX)
+		*proxy = dbus_g_proxy_new_for_name(conn,
+						   BT_AGENT_SERVICE,
+						   BT_OBEX_AGENT_PATH,
+						   BT_OBEX_AGENT_INTERFACE);
+	else
+		*proxy = dbus_g_proxy_new_for_name(conn,
+						   BT_AGENT_SERVICE,
+						   BT_AGENT_PATH,
+						   BT_AGENT_INTERFACE);
+
+	if (*proxy == NULL) {
+		bt_log_print(BT_POPUP, "Could not create %s dbus proxy",
+			     (type == BT_PROXY_OBEX) ? "obex" : "agent");
+		return NULL;
+	}
+
+	__bluetooth_watch_agent(ad, *proxy);
+
+	bt_log_print(BT_POPUP, "%s proxy in %lld us",
+		     (type == BT_PROXY_OBEX) ? "obex" : "agent",
+		     (long long)(g_get_monotonic_time() - start));
+
+	return *proxy;
+}
+
+static int __bluetooth_init_app_signal(struct bt_popup_appdata *ad);
+
+static const char *bt_reply_method_name[BT_REPLY_METHOD_MAX] = {
+	[BT_REPLY_PIN_CODE] = "ReplyPinCode",
+	[BT_REPLY_PASSKEY] = "ReplyPassKey",
+	[BT_REPLY_CONFIRMATION] = "ReplyConfirmation",
+	[BT_REPLY_AUTHORIZE] = "ReplyAuthorize",
+	[BT_REPLY_OVERWRITE] = "ReplyOverwrite",
+};
+
+/* Reply sent to the agent and not acknowledged yet */
+struct bt_pending_reply {
+	struct bt_popup_appdata *ad;
+	bt_popup_event_type_t event_type;
+	bt_reply_method_t method;
+	gint64 sent;
+};
+
+static void __bluetooth_reply_notify_cb(DBusGProxy *proxy,
+					DBusGProxyCall *call, void *user_data)
+{
+	struct bt_pending_reply *reply = user_data;
+	struct bt_popup_appdata *ad = reply->ad;
+	struct bt_reply_stats *stats = &ad->reply_stats[reply->method];
+	struct bt_event_stats *event_stats;
+	GError *err = NULL;
+	gint64 latency;
+
+	latency = g_get_monotonic_time() - reply->sent;
+	ad->pending_replies--;
+
+	if (!dbus_g_proxy_end_call(proxy, call, &err, G_TYPE_INVALID)) {
+		bt_log_print(BT_POPUP, "%s failed [%s]",
+			     bt_reply_method_name[reply->method],
+			     err ? err->message : "");
+		stats->failed++;
+		if (err)
+			g_error_free(err);
+		return;
+	}
+
+	stats->acked++;
+	stats->total_us += latency;
+	if (latency > stats->max_us)
+		stats->max_us = latency;
+
+	__bluetooth_open_recorder();
+	event_stats = bt_recorder_stats(reply->event_type);
+	if (event_stats)
+		bt_histogram_add(&event_stats->reply, latency);
+
+	bt_log_print(BT_POPUP, "%s acked in %lld us",
+		     bt_reply_method_name[reply->method], (long long)latency);
+}
+
+/* All agent replies go through here. The reply is sent asynchronously and
+   tracked until the agent acknowledges it. */
+static void __bluetooth_agent_reply(struct bt_popup_appdata *ad,
+				    bt_popup_event_type_t event_type,
+				    bt_proxy_type_t type,
+				    bt_reply_method_t method,
+				    guint response, const char *passkey)
+{
+	struct bt_pending_reply *reply;
+	DBusGProxyCall *call;
+	DBusGProxy *proxy;
+
+	proxy = __bluetooth_get_proxy(ad, type);
+	if (proxy == NULL) {
+		bt_log_print(BT_POPUP, "No proxy for %s",
+			     bt_reply_method_name[method]);
+		return;
+	}
+
+	reply = g_new0(struct bt_pending_reply, 1);
+	reply->ad = ad;
+	reply->event_type = event_type;
+	reply->method = method;
+	reply->sent = g_get_monotonic_time();
+
+	if (method == BT_REPLY_PIN_CODE || method == BT_REPLY_PASSKEY)
+		call = dbus_g_proxy_begin_call(proxy,
+					bt_reply_method_name[method],
+					__bluetooth_reply_notify_cb,
+					reply, g_free,
+					G_TYPE_UINT, response,
+					G_TYPE_STRING, passkey ? passkey : "",
+					G_TYPE_INVALID);
+	else
+		call = dbus_g_proxy_begin_call(proxy,
+					bt_reply_method_name[method],
+					__bluetooth_reply_notify_cb,
+					reply, g_free,
+					G_TYPE_UINT, response,
+					G_TYPE_INVALID);
+
+	if (call == NULL) {
+		bt_log_print(BT_POPUP, "Fail to send %s",
+			     bt_reply_method_name[method]);
+		ad->reply_stats[method].failed++;
+		return;
+	}
+
+	ad->reply_stats[method].sent++;
+	ad->pending_replies++;
+}
+
+/* Wait, bounded by BT_REPLY_FLUSH_TIMEOUT, until the agent has acknowledged
+   every reply. Exiting earlier may drop a reply still in the queue.
+   Only the bus connection is serviced: running the main loop here would
+   also dispatch AUL resets and timers, and draw a request we then exit
+   without answering. */
+static void __bluetooth_flush_replies(struct bt_popup_appdata *ad)
+{
+	DBusConnection *conn;
+	gint64 deadline;
+	int remaining;
+	int i;
+
+	if (ad->conn) {
+		conn = dbus_g_connection_get_connection(ad->conn);
+		dbus_connection_flush(conn);
+
+		deadline = g_get_monotonic_time() +
+			   BT_REPLY_FLUSH_TIMEOUT * 1000;
+
+		/* The pending call notifies run __bluetooth_reply_notify_cb */
+		while (ad->pending_replies > 0) {
+			remaining = (deadline - g_get_monotonic_time()) / 1000;
+			if (remaining <= 0 ||
+			    !dbus_connection_read_write_dispatch(conn,
+								 remaining))
+				break;
+		}
+
+		if (ad->pending_replies > 0)
+			bt_log_print(BT_POPUP, "%d replies not acked",
+				     ad->pending_replies);
+	}
+
+	for (i = 0; i < BT_REPLY_METHOD_MAX; i++) {
+		struct bt_reply_stats *stats = &ad->reply_stats[i];
+
+		if (stats->sent == 0)
+			continue;
+
+		bt_log_print(BT_POPUP, "%s sent[%u] acked[%u] failed[%u] "
+			     "avg[%lld us] max[%lld us]",
+			     bt_reply_method_name[i], stats->sent,
+			     stats->acked, stats->failed,
+			     stats->acked ? (long long)(stats->total_us /
+							stats->acked) : 0,
+			     (long long)stats->max_us);
+	}
+}
+
+/* Response of an app-confirm-request, sent on the agent's connection */
+static void __bluetooth_send_app_response(struct bt_popup_appdata *ad,
+					  int response)
+{
+	DBusMessage *msg = NULL;
+
+	if (__bluetooth_get_connection(ad) == NULL)
+		return;
+
+	if (!ad->name_requested) {
+		ad->name_requested = TRUE;
+		if (!__bluetooth_init_app_signal(ad))
+			bt_log_print(BT_POPUP,
+				     "__bt_syspopup_init_app_signal failed");
+	}
+
+	msg = dbus_message_new_signal(BT_SYS_POPUP_IPC_RESPONSE_OBJECT,
+				      BT_SYS_POPUP_INTERFACE,
+				      BT_SYS_POPUP_METHOD_RESPONSE);
+	if (msg == NULL)
+		return;
+
+	dbus_message_append_args(msg,
+				 DBUS_TYPE_INT32, &response, DBUS_TYPE_INVALID);
+
+	dbus_connection_send(dbus_g_connection_get_connection(ad->conn),
+			     msg, NULL);
+	dbus_message_unref(msg);
+}
+
+/* Reply to the agent for a request which is not (or no longer) answered
+   by the user. BT_AGENT_ACCEPT uses the accept reply of the event, any
+   other response code its cancel reply. */
+static void __bluetooth_send_reply(struct bt_popup_appdata *ad,
+				   const struct bt_event_desc *desc,
+				   int response)
+{
+	const struct bt_reply_desc *reply;
+
+	if (desc == NULL)
+		return;
+
+	reply = (response == BT_AGENT_ACCEPT) ? &desc->accept : &desc->cancel;
+
+	switch (reply->kind) {
+	case BT_REPLY_KIND_METHOD:
+		__bluetooth_agent_reply(ad, desc->event_type, reply->proxy,
+					reply->method, response, "");
+		break;
+
+	case BT_REPLY_KIND_SIGNAL:
+		/* For timeout rejection is sent to  be handled in
+		   application */
+		__bluetooth_send_app_response(ad,
+				(response == BT_AGENT_ACCEPT) ? 0 : 1);
 		break;
 
 	default:
 		break;
 	}
+}
+
+/* The user declined a request which has no button reply of its own */
+static void __bluetooth_request_to_cancel(struct bt_popup_appdata *ad)
+{
+	if (ad == NULL || ad->request == NULL)
+		return;
+
+	__bluetooth_send_reply(ad, ad->request->desc, BT_AGENT_CANCEL);
+}
+
+static void __bluetooth_cancel_queued_requests(struct bt_popup_appdata *ad)
+{
+	struct bt_popup_request *req;
+
+	while ((req = __bluetooth_request_dequeue(ad)) != NULL) {
+		__bluetooth_request_outcome(req, BT_RECORD_TERMINATED,
+					    BT_RECORD_RESPONSE_CANCEL);
+		__bluetooth_send_reply(ad, req->desc, BT_AGENT_CANCEL);
+		__bluetooth_request_free(req);
+	}
+}
+
+static void __bluetooth_remove_all_event(struct bt_popup_appdata *ad)
+{
+	if (ad->request) {
+		/* Unless the key or the timeout said why before */
+		__bluetooth_request_outcome(ad->request, BT_RECORD_ERROR,
+					    BT_RECORD_RESPONSE_CANCEL);
+		__bluetooth_send_reply(ad, ad->request->desc, BT_AGENT_CANCEL);
+	}
 
 	__bluetooth_win_del(ad);
 }
 
+static int __bluetooth_grant_timeout_cb(void *data);
+
+/* Drop the expired grants and arm the timer for the next expiry */
+static void __bluetooth_expire_obex_grants(struct bt_popup_appdata *ad)
+{
+	struct bt_obex_grant *grant;
+	double now = ecore_time_get();
+	double next = 0;
+	int i;
+
+	for (i = 0; i < BT_OBEX_GRANT_MAX; i++) {
+		grant = &ad->grants[i];
+		if (grant->event_type == 0x0000)
+			continue;
+
+		if (grant->expiry <= now) {
+			bt_log_print(BT_POPUP, "Grant [%s] event[0x%04x] "
+				     "covered %d requests", grant->device,
+				     grant->event_type, grant->covered);
+			memset(grant, 0x0, sizeof(struct bt_obex_grant));
+			continue;
+		}
+
+		if (next == 0 || grant->expiry < next)
+			next = grant->expiry;
+	}
+
+	if (ad->grant_timer) {
+		ecore_timer_del(ad->grant_timer);
+		ad->grant_timer = NULL;
+	}
+
+	if (next > 0)
+		ad->grant_timer = ecore_timer_add(next - now, (Ecore_Task_Cb)
+						  __bluetooth_grant_timeout_cb,
+						  ad);
+}
+
+static int __bluetooth_grant_timeout_cb(void *data)
+{
+	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
+
+	if (ad == NULL)
+		return 0;
+
+	ad->grant_timer = NULL;
+	__bluetooth_expire_obex_grants(ad);
+
+	/* The process was only kept alive for the grants */
+	if (ad->grant_timer == NULL && ad->request == NULL && !ad->resident)
+		__bluetooth_exit(ad);
+
+	return 0;
+}
+
+/* Record an "accept all" answer for the device of the shown request.
+   Grants are keyed on the address only: any nearby device may advertise
+   the same name. */
+static void __bluetooth_add_obex_grant(struct bt_popup_appdata *ad)
+{
+	struct bt_obex_grant *grant = NULL;
+	const char *device;
+	int i;
+
+	if (ad->request == NULL)
+		return;
+
+	device = ad->request->data.device_address;
+	if (device == NULL) {
+		bt_log_print(BT_POPUP, "No device address, no grant");
+		return;
+	}
+
+	for (i = 0; i < BT_OBEX_GRANT_MAX; i++) {
+		if (ad->grants[i].event_type == ad->event_type &&
+		    !strcmp(ad->grants[i].device, device)) {
+			grant = &ad->grants[i];
+			break;
+		}
+
+		/* Free slot, or else the grant closest to its expiry */
+		if (grant == NULL)
+			grant = &ad->grants[i];
+		else if (grant->event_type != 0x0000 &&
+			 (ad->grants[i].event_type == 0x0000 ||
+			  ad->grants[i].expiry < grant->expiry))
+			grant = &ad->grants[i];
+	}
+
+	if (grant->event_type != ad->event_type ||
+	    strcmp(grant->device, device)) {
+		memset(grant, 0x0, sizeof(struct bt_obex_grant));
+		g_strlcpy(grant->device, device, sizeof(grant->device));
+		grant->event_type = ad->event_type;
+	}
+
+	grant->expiry = ecore_time_get() + BT_OBEX_GRANT_TIMEOUT;
+
+	bt_log_print(BT_POPUP, "Grant [%s] event[0x%04x] for %d sec",
+		     grant->device, grant->event_type, BT_OBEX_GRANT_TIMEOUT);
+
+	__bluetooth_expire_obex_grants(ad);
+}
+
+/* Answer a request covered by a grant without drawing anything */
+static gboolean __bluetooth_check_obex_grant(struct bt_popup_appdata *ad,
+					     struct bt_popup_request *req)
+{
+	const char *device;
+	double now;
+	int i;
+
+	if (req->event_type != BT_EVENT_PUSH_AUTHORIZE_REQUEST &&
+	    req->event_type != BT_EVENT_CONFIRM_OVERWRITE_REQUEST)
+		return FALSE;
+
+	device = req->data.device_address;
+	if (device == NULL)
+		return FALSE;
+
+	now = ecore_time_get();
+
+	for (i = 0; i < BT_OBEX_GRANT_MAX; i++) {
+		if (ad->grants[i].event_type != req->event_type ||
+		    ad->grants[i].expiry <= now ||
+		    strcmp(ad->grants[i].device, device))
+			continue;
+
+		ad->grants[i].covered++;
+		__bluetooth_request_outcome(req, BT_RECORD_GRANT,
+					    BT_RECORD_RESPONSE_ACCEPT);
+		__bluetooth_send_reply(ad, req->desc, BT_AGENT_ACCEPT);
+
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Answer a request decided by the policy file without drawing anything */
+static gboolean __bluetooth_check_policy(struct bt_popup_appdata *ad,
+					 struct bt_popup_request *req)
+{
+	const struct bt_policy_rule *rule;
+
+	if (!req->desc->policy)
+		return FALSE;
+
+	if (!ad->policy_loaded) {
+		ad->policy_loaded = EINA_TRUE;
+		ad->policy = bt_policy_load(BT_POLICY_FILE);
+	}
+
+	rule = bt_policy_match(ad->policy, req->desc->name,
+			       req->data.device_address,
+			       req->data.device_name, req->data.service);
+	if (rule == NULL)
+		return FALSE;
+
+	bt_log_print(BT_POPUP, "Rule [%s] %s %s from [%s]", rule->name,
+		     bt_policy_action_name(rule->action), req->desc->name,
+		     __bluetooth_get_device_id(req));
+
+	switch (rule->action) {
+	case BT_POLICY_ACCEPT:
+		__bluetooth_request_outcome(req, BT_RECORD_POLICY,
+					    BT_RECORD_RESPONSE_ACCEPT);
+		__bluetooth_send_reply(ad, req->desc, BT_AGENT_ACCEPT);
+		return TRUE;
+
+	case BT_POLICY_REJECT:
+		__bluetooth_request_outcome(req, BT_RECORD_POLICY,
+					    BT_RECORD_RESPONSE_REJECT);
+		__bluetooth_send_reply(ad, req->desc, BT_AGENT_REJECT);
+		return TRUE;
+
+	default:
+		return FALSE;
+	}
+}
+
+static bt_btn_response_t __bluetooth_btn_response(Evas_Object *obj)
+{
+	return GPOINTER_TO_INT(evas_object_data_get(obj,
+						    BT_BTN_RESPONSE_KEY));
+}
+
 static int __bluetooth_keydown_cb(void *data, int type, void *event_info)
 {
 	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
 	Ecore_Event_Key *ev = event_info;
 
+	/* Resident mode keeps the handler while no popup is shown */
+	if (ad->popup == NULL)
+		return 0;
+
 	if (!strcmp(ev->keyname, KEY_END) || !strcmp(ev->keyname, KEY_SELECT)) {
 		bt_log_print(BT_POPUP, "Key [%s]", ev->keyname);
 		/* remove_all_event(); */
 
 		if (!strcmp(ev->keyname, KEY_END)) {
+			__bluetooth_trace_mark(ad, BT_TRACE_USER_RESPONSE);
+			__bluetooth_request_outcome(ad->request,
+						    BT_RECORD_USER,
+						    BT_RECORD_RESPONSE_CANCEL);
 			__bluetooth_remove_all_event(ad);
 		}
 	}
@@ -215,6 +1373,71 @@ static int __bluetooth_keydown_cb(void *data, int type, void *event_info)
 	return 0;
 }
 
+static int __bluetooth_request_timeout_cb(void *data);
+
+/* One timer for the shown and all queued requests, due at the earliest
+   deadline among them */
+static void __bluetooth_schedule_expiry(struct bt_popup_appdata *ad)
+{
+	double deadline = 0;
+	double timeout;
+	int i;
+
+	if (ad->timer) {
+		ecore_timer_del(ad->timer);
+		ad->timer = NULL;
+	}
+
+	if (ad->request && ad->event_type != BT_EVENT_FILE_RECIEVED)
+		deadline = ad->request->deadline;
+
+	for (i = 0; i < ad->queue_len; i++) {
+		if (ad->queue[i]->timeout == 0)
+			continue;
+		if (deadline == 0 || ad->queue[i]->deadline < deadline)
+			deadline = ad->queue[i]->deadline;
+	}
+
+	if (deadline == 0)
+		return;
+
+	timeout = deadline - ecore_time_get();
+	if (timeout < 0)
+		timeout = 0;
+
+	ad->timer = ecore_timer_add(timeout, (Ecore_Task_Cb)
+				    __bluetooth_request_timeout_cb, ad);
+}
+
+/* Cancel the queued requests the agent has given up on */
+static void __bluetooth_expire_queued_requests(struct bt_popup_appdata *ad)
+{
+	struct bt_popup_request *req;
+	double now = ecore_time_get();
+	int i = 0;
+
+	while (i < ad->queue_len) {
+		req = ad->queue[i];
+		/* Display only, nothing waits for it */
+		if (req->timeout == 0 || req->deadline > now) {
+			i++;
+			continue;
+		}
+
+		bt_log_print(BT_POPUP, "Request [0x%04x] expired in queue",
+			     req->event_type);
+
+		memmove(&ad->queue[i], &ad->queue[i + 1],
+			(ad->queue_len - i - 1) * sizeof(ad->queue[0]));
+		ad->queue_len--;
+
+		__bluetooth_request_outcome(req, BT_RECORD_EXPIRED,
+					    BT_RECORD_RESPONSE_CANCEL);
+		__bluetooth_send_reply(ad, req->desc, BT_AGENT_CANCEL);
+		__bluetooth_request_free(req);
+	}
+}
+
 static int __bluetooth_request_timeout_cb(void *data)
 {
 	struct bt_popup_appdata *ad;
@@ -223,24 +1446,111 @@ static int __bluetooth_request_timeout_cb(void *data)
 		return 0;
 
 	ad = (struct bt_popup_appdata *)data;
+	ad->timer = NULL;
 
-	bt_log_print(BT_POPUP, "Request time out, Canceling reqeust");
+	__bluetooth_expire_queued_requests(ad);
 
-	/* Destory UI and timer */
-	if (ad->timer) {
-		ecore_timer_del(ad->timer);
-		ad->timer = NULL;
+	if (ad->request && ad->request->deadline <= ecore_time_get()) {
+		bt_log_print(BT_POPUP, "Request time out, Canceling reqeust");
+		__bluetooth_request_outcome(ad->request, BT_RECORD_TIMEOUT,
+					    BT_RECORD_RESPONSE_CANCEL);
+		/* Destroys the UI and schedules the next request */
+		__bluetooth_remove_all_event(ad);
+		return 0;
 	}
 
-	__bluetooth_remove_all_event(ad);
+	__bluetooth_schedule_expiry(ad);
+
 	return 0;
 }
 
+/* Time from the request to the PIN code or passkey reply, per device */
+static void __bluetooth_report_pairing(struct bt_popup_appdata *ad,
+				       struct bt_popup_request *req,
+				       gboolean provisioned)
+{
+	struct bt_pairing_stats *stats = &ad->pairing_stats;
+	gint64 turnaround;
+
+	if (req == NULL)
+		return;
+
+	turnaround = g_get_monotonic_time() - req->trace[BT_TRACE_RESET];
+
+	stats->paired++;
+	stats->total_us += turnaround;
+	if (provisioned)
+		stats->provisioned++;
+
+	bt_log_print(BT_POPUP, "Paired [%s] %s in %lld us, %u devices "
+		     "(%u provisioned), mean %lld us",
+		     __bluetooth_get_device_id(req),
+		     provisioned ? "provisioned" : "typed",
+		     (long long)turnaround, stats->paired, stats->provisioned,
+		     (long long)(stats->total_us / stats->paired));
+}
+
+#ifdef BT_PROVISIONING
+/* A passkey is at most BT_PK_MLEN digits, a PIN code any BT_PIN_MLEN
+   characters */
+static gboolean __bluetooth_provision_code_fits(struct bt_popup_request *req,
+						const char *code)
+{
+	int i;
+
+	if (req->event_type != BT_EVENT_PASSKEY_REQUEST)
+		return strlen(code) <= BT_PIN_MLEN;
+
+	for (i = 0; code[i] != '\0'; i++) {
+		if (i >= BT_PK_MLEN || !g_ascii_isdigit(code[i]))
+			return FALSE;
+	}
+
+	return i > 0;
+}
+
+/* Answer a PIN or passkey request from the provisioning store */
+static gboolean __bluetooth_check_provision(struct bt_popup_appdata *ad,
+					    struct bt_popup_request *req)
+{
+	const char *code;
+
+	if (req->event_type != BT_EVENT_PIN_REQUEST &&
+	    req->event_type != BT_EVENT_PASSKEY_REQUEST)
+		return FALSE;
+
+	if (!ad->provision_loaded) {
+		ad->provision_loaded = EINA_TRUE;
+		ad->provision = bt_provision_load(BT_PROVISION_FILE);
+	}
+
+	code = bt_provision_lookup(ad->provision, req->data.device_address,
+				   req->data.device_name);
+	if (code == NULL)
+		return FALSE;
+
+	if (!__bluetooth_provision_code_fits(req, code)) {
+		bt_log_print(BT_POPUP, "Provisioned code of [%s] is not a "
+			     "valid %s", __bluetooth_get_device_id(req),
+			     req->desc->name);
+		return FALSE;
+	}
+
+	__bluetooth_request_outcome(req, BT_RECORD_PROVISIONED,
+				    BT_RECORD_RESPONSE_ACCEPT);
+	__bluetooth_agent_reply(ad, req->event_type, req->desc->accept.proxy,
+				req->desc->accept.method, BT_AGENT_ACCEPT,
+				code);
+	__bluetooth_report_pairing(ad, req, TRUE);
+
+	return TRUE;
+}
+#endif
+
 static void __bluetooth_input_request_cb(void *data,
 				       Evas_Object *obj, void *event_info)
 {
 	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
-	const char *event = elm_object_text_get(obj);
 	int response = 0;
 	char *input_text = NULL;
 	char *convert_input_text = NULL;
@@ -257,52 +1567,35 @@ static void __bluetooth_input_request_cb(void *data,
 		    elm_entry_markup_to_utf8(input_text);
 	}
 
-	if (!strcmp(event, BT_STR_OK))
+	/* Without input the agent still waits for an answer, cancel it */
+	if (__bluetooth_btn_response(obj) == BT_BTN_ACCEPT &&
+	    convert_input_text != NULL)
 		response = 1;
 	else
 		response = 0;
 
-	if (convert_input_text == NULL)
-		return;
-
 	bt_log_print(BT_POPUP, "PIN/Passkey[%s] event[%d] response[%d]",
-		     convert_input_text, ad->event_type, response);
+		     convert_input_text ? convert_input_text : "",
+		     ad->event_type, response);
 
 	if (response == 1) {
 		bt_log_print(BT_POPUP, "Done case");
+		__bluetooth_report_pairing(ad, ad->request, FALSE);
 		if (ad->event_type == BT_EVENT_PIN_REQUEST) {
-			dbus_g_proxy_call_no_reply(ad->agent_proxy,
-						   "ReplyPinCode",
-						   G_TYPE_UINT, BT_AGENT_ACCEPT,
-						   G_TYPE_STRING,
-						   convert_input_text,
-						   G_TYPE_INVALID,
-						   G_TYPE_INVALID);
+			__bluetooth_agent_reply(ad, ad->event_type, BT_PROXY_AGENT,
+							BT_REPLY_PIN_CODE, BT_AGENT_ACCEPT, convert_input_text);
 		} else {
-			dbus_g_proxy_call_no_reply(ad->agent_proxy,
-						   "ReplyPassKey",
-						   G_TYPE_UINT, BT_AGENT_ACCEPT,
-						   G_TYPE_STRING,
-						   convert_input_text,
-						   G_TYPE_INVALID,
-						   G_TYPE_INVALID);
+			__bluetooth_agent_reply(ad, ad->event_type, BT_PROXY_AGENT,
+							BT_REPLY_PASSKEY, BT_AGENT_ACCEPT, convert_input_text);
 		}
 	} else {
 		bt_log_print(BT_POPUP, "Cancel case");
 		if (ad->event_type == BT_EVENT_PIN_REQUEST) {
-			dbus_g_proxy_call_no_reply(ad->agent_proxy,
-						   "ReplyPinCode",
-						   G_TYPE_UINT, BT_AGENT_CANCEL,
-						   G_TYPE_STRING, "",
-						   G_TYPE_INVALID,
-						   G_TYPE_INVALID);
+			__bluetooth_agent_reply(ad, ad->event_type, BT_PROXY_AGENT,
+							BT_REPLY_PIN_CODE, BT_AGENT_CANCEL, "");
 		} else {
-			dbus_g_proxy_call_no_reply(ad->agent_proxy,
-						   "ReplyPassKey",
-						   G_TYPE_UINT, BT_AGENT_CANCEL,
-						   G_TYPE_STRING, "",
-						   G_TYPE_INVALID,
-						   G_TYPE_INVALID);
+			__bluetooth_agent_reply(ad, ad->event_type, BT_PROXY_AGENT,
+							BT_REPLY_PASSKEY, BT_AGENT_CANCEL, "");
 		}
 	}
 
@@ -318,7 +1611,7 @@ static void __bluetooth_input_cancel_cb(void *data,
 {
 	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
 
-	__bluetooth_request_to_cancel();
+	__bluetooth_request_to_cancel(ad);
 
 	__bluetooth_delete_input_view(ad);
 
@@ -332,23 +1625,18 @@ static void __bluetooth_passkey_confirm_cb(void *data,
 		return;
 
 	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
-	const char *event = elm_object_text_get(obj);
 
 	if (ad == NULL)
 		return;
 
-	if (!strcmp(event, BT_STR_OK)) {
-		dbus_g_proxy_call_no_reply(ad->agent_proxy, "ReplyConfirmation",
-					   G_TYPE_UINT, BT_AGENT_ACCEPT,
-					   G_TYPE_INVALID, G_TYPE_INVALID);
+	if (__bluetooth_btn_response(obj) == BT_BTN_ACCEPT) {
+		__bluetooth_agent_reply(ad, ad->event_type, BT_PROXY_AGENT,
+						BT_REPLY_CONFIRMATION, BT_AGENT_ACCEPT, NULL);
 	} else {
-		dbus_g_proxy_call_no_reply(ad->agent_proxy, "ReplyConfirmation",
-					   G_TYPE_UINT, BT_AGENT_CANCEL,
-					   G_TYPE_INVALID, G_TYPE_INVALID);
+		__bluetooth_agent_reply(ad, ad->event_type, BT_PROXY_AGENT,
+						BT_REPLY_CONFIRMATION, BT_AGENT_CANCEL, NULL);
 	}
 
-	evas_object_del(obj);
-
 	__bluetooth_win_del(ad);
 }
 
@@ -357,16 +1645,28 @@ static int __bluetooth_init_app_signal(struct bt_popup_appdata *ad)
 	if (NULL == ad)
 		return FALSE;
 
-	e_dbus_init();
-	ad->EDBusHandle = e_dbus_bus_get(DBUS_BUS_SYSTEM);
-	if (!ad->EDBusHandle) {
-		bt_log_print(BT_POPUP, "e_dbus_bus_get failed  \n ");
+	DBusError err;
+	gint64 start;
+
+	if (NULL == ad->conn)
+		return FALSE;
+
+	start = g_get_monotonic_time();
+
+	/* Same connection as the agent proxies, no second bus handshake */
+	dbus_error_init(&err);
+	dbus_bus_request_name(dbus_g_connection_get_connection(ad->conn),
+			      BT_SYS_POPUP_IPC_NAME, 0, &err);
+	if (dbus_error_is_set(&err)) {
+		bt_log_print(BT_POPUP, "Fail to request name [%s]",
+			     err.message);
+		dbus_error_free(&err);
 		return FALSE;
-	} else {
-		bt_log_print(BT_POPUP, "e_dbus_bus_get success \n ");
-		e_dbus_request_name(ad->EDBusHandle,
-				    BT_SYS_POPUP_IPC_NAME, 0, NULL, NULL);
 	}
+
+	bt_log_print(BT_POPUP, "Bus name in %lld us",
+		     (long long)(g_get_monotonic_time() - start));
+
 	return TRUE;
 }
 
@@ -378,27 +1678,14 @@ static void __bluetooth_app_confirm_cb(void *data,
 		return;
 
 	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
-	const char *event = elm_object_text_get(obj);
-
-	DBusMessage *msg = NULL;
 	int response = 0;
 
-	msg = dbus_message_new_signal(BT_SYS_POPUP_IPC_RESPONSE_OBJECT,
-				      BT_SYS_POPUP_INTERFACE,
-				      BT_SYS_POPUP_METHOD_RESPONSE);
-
-	if (!strcmp(event, BT_STR_YES) || !strcmp(event, BT_STR_OK))
+	if (__bluetooth_btn_response(obj) == BT_BTN_ACCEPT)
 		response = 0;
 	else
 		response = 1;
 
-	dbus_message_append_args(msg,
-				 DBUS_TYPE_INT32, &response, DBUS_TYPE_INVALID);
-
-	e_dbus_message_send(ad->EDBusHandle, msg, NULL, -1, NULL);
-	dbus_message_unref(msg);
-
-	evas_object_del(obj);
+	__bluetooth_send_app_response(ad, response);
 
 	__bluetooth_win_del(ad);
 }
@@ -411,16 +1698,12 @@ static void __bluetooth_authorization_request_cb(void *data,
 	if (obj == NULL || ad == NULL)
 		return;
 
-	const char *event = elm_object_text_get(obj);
-
-	if (!strcmp(event, BT_STR_YES)) {
-		dbus_g_proxy_call_no_reply(ad->agent_proxy, "ReplyAuthorize",
-					   G_TYPE_UINT, BT_AGENT_ACCEPT,
-					   G_TYPE_INVALID, G_TYPE_INVALID);
+	if (__bluetooth_btn_response(obj) == BT_BTN_ACCEPT) {
+		__bluetooth_agent_reply(ad, ad->event_type, BT_PROXY_AGENT, BT_REPLY_AUTHORIZE,
+						BT_AGENT_ACCEPT, NULL);
 	} else {
-		dbus_g_proxy_call_no_reply(ad->agent_proxy, "ReplyAuthorize",
-					   G_TYPE_UINT, BT_AGENT_CANCEL,
-					   G_TYPE_INVALID, G_TYPE_INVALID);
+		__bluetooth_agent_reply(ad, ad->event_type, BT_PROXY_AGENT, BT_REPLY_AUTHORIZE,
+						BT_AGENT_CANCEL, NULL);
 	}
 
 	__bluetooth_win_del(ad);
@@ -434,16 +1717,17 @@ static void __bluetooth_push_authorization_request_cb(void *data,
 	if (obj == NULL || ad == NULL)
 		return;
 
-	const char *event = elm_object_text_get(obj);
+	bt_btn_response_t response = __bluetooth_btn_response(obj);
+
+	if (response == BT_BTN_ACCEPT_ALL)
+		__bluetooth_add_obex_grant(ad);
 
-	if (!strcmp(event, BT_STR_YES))
-		dbus_g_proxy_call_no_reply(ad->obex_proxy, "ReplyAuthorize",
-					   G_TYPE_UINT, BT_AGENT_ACCEPT,
-					   G_TYPE_INVALID, G_TYPE_INVALID);
+	if (response == BT_BTN_ACCEPT || response == BT_BTN_ACCEPT_ALL)
+		__bluetooth_agent_reply(ad, ad->event_type, BT_PROXY_OBEX, BT_REPLY_AUTHORIZE,
+						BT_AGENT_ACCEPT, NULL);
 	else
-		dbus_g_proxy_call_no_reply(ad->obex_proxy, "ReplyAuthorize",
-					   G_TYPE_UINT, BT_AGENT_CANCEL,
-					   G_TYPE_INVALID, G_TYPE_INVALID);
+		__bluetooth_agent_reply(ad, ad->event_type, BT_PROXY_OBEX, BT_REPLY_AUTHORIZE,
+						BT_AGENT_CANCEL, NULL);
 
 	__bluetooth_win_del(ad);
 }
@@ -456,86 +1740,92 @@ static void __bluetooth_confirm_overwrite_request_cb(void *data,
 	if (obj == NULL || ad == NULL)
 		return;
 
-	const char *event = elm_object_text_get(obj);
+	bt_btn_response_t response = __bluetooth_btn_response(obj);
 
-	if (!strcmp(event, BT_STR_YES))
-		dbus_g_proxy_call_no_reply(ad->obex_proxy, "ReplyOverwrite",
-					   G_TYPE_UINT, BT_AGENT_ACCEPT,
-					   G_TYPE_INVALID, G_TYPE_INVALID);
+	if (response == BT_BTN_ACCEPT_ALL)
+		__bluetooth_add_obex_grant(ad);
+
+	if (response == BT_BTN_ACCEPT || response == BT_BTN_ACCEPT_ALL)
+		__bluetooth_agent_reply(ad, ad->event_type, BT_PROXY_OBEX, BT_REPLY_OVERWRITE,
+						BT_AGENT_ACCEPT, NULL);
 	else
-		dbus_g_proxy_call_no_reply(ad->obex_proxy, "ReplyOverwrite",
-					   G_TYPE_UINT, BT_AGENT_CANCEL,
-					   G_TYPE_INVALID, G_TYPE_INVALID);
+		__bluetooth_agent_reply(ad, ad->event_type, BT_PROXY_OBEX, BT_REPLY_OVERWRITE,
+						BT_AGENT_CANCEL, NULL);
 
 	__bluetooth_win_del(ad);
 }
 
-static void __bluetooth_ime_hide(void)
+/* The keypad is shown and hidden through the context of the input view
+   entry, see __bluetooth_create_input_view */
+static void __bluetooth_ime_hide(struct bt_popup_appdata *ad)
 {
-	Ecore_IMF_Context *imf_context = NULL;
-	imf_context = ecore_imf_context_add(ecore_imf_context_default_id_get());
-	if (imf_context)
-		ecore_imf_context_input_panel_hide(imf_context);
+	if (ad == NULL || ad->imf_context == NULL)
+		return;
+
+	ecore_imf_context_input_panel_hide(ad->imf_context);
 }
 
+#ifdef BT_PASSKEY_AUTO_SUBMIT
+static void __bluetooth_auto_submit_job_cb(void *data)
+{
+	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
+
+	ad->submit_job = NULL;
+
+	if (ad->popup == NULL || ad->event_type != BT_EVENT_PASSKEY_REQUEST)
+		return;
+
+	bt_log_print(BT_POPUP, "Passkey complete, submit");
+
+	__bluetooth_trace_mark(ad, BT_TRACE_USER_RESPONSE);
+	__bluetooth_request_outcome(ad->request, BT_RECORD_USER,
+				    BT_RECORD_RESPONSE_ACCEPT);
+	__bluetooth_input_request_cb(ad, ad->edit_field_save_btn, NULL);
+}
+#endif
+
+/* Length and characters are already limited by the entry filters, see
+   __bluetooth_set_input_filter, so nothing is converted or reset here */
 static void __bluetooth_entry_change_cb(void *data, Evas_Object *obj,
 				      void *event_info)
 {
 	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
-	char *input_text = NULL;
-	char *convert_input_text = NULL;
-	char *output_text = NULL;
-	int text_length = 0;
 
-	input_text = (char *)elm_entry_entry_get(obj);
-
-	if (input_text) {
-		convert_input_text = elm_entry_markup_to_utf8(input_text);
-		if (convert_input_text) {
-			text_length = strlen(convert_input_text);
-
-			if (text_length == 0) {
-				elm_object_disabled_set(ad->edit_field_save_btn,
-							EINA_TRUE);
-				elm_object_signal_emit(ad->editfield,
-							"elm,state,eraser,hide",
-							"elm");
-			} else {
-				elm_object_disabled_set(ad->edit_field_save_btn,
-							EINA_FALSE);
-				elm_object_signal_emit(ad->editfield,
-							"elm,state,eraser,show",
-							"elm");
-			}
+	if (elm_entry_is_empty(obj)) {
+		elm_object_disabled_set(ad->edit_field_save_btn, EINA_TRUE);
+		elm_object_signal_emit(ad->editfield,
+				       "elm,state,eraser,hide", "elm");
+		return;
+	}
 
-			if (ad->event_type == BT_EVENT_PASSKEY_REQUEST) {
-				if (text_length > BT_PK_MLEN) {
-					text_length = BT_PK_MLEN;
-					convert_input_text[BT_PK_MLEN] = '\0';
-					output_text =
-					    elm_entry_utf8_to_markup
-					    (convert_input_text);
-
-					elm_entry_entry_set(obj, output_text);
-					elm_entry_cursor_end_set(obj);
-					free(output_text);
-				}
-			} else {
-				if (text_length > BT_PIN_MLEN) {
-					text_length = BT_PIN_MLEN;
-					convert_input_text[BT_PIN_MLEN] = '\0';
-					output_text =
-					    elm_entry_utf8_to_markup
-						(convert_input_text);
-
-					elm_entry_entry_set(obj, output_text);
-					elm_entry_cursor_end_set(obj);
-					free(output_text);
-				}
-			}
-			free(convert_input_text);
-		}
+	elm_object_disabled_set(ad->edit_field_save_btn, EINA_FALSE);
+	elm_object_signal_emit(ad->editfield, "elm,state,eraser,show", "elm");
+
+#ifdef BT_PASSKEY_AUTO_SUBMIT
+	/* A passkey has only digits, its markup is the plain text. The reply
+	   is sent from a job, not from inside the entry's callback. */
+	if (ad->event_type == BT_EVENT_PASSKEY_REQUEST &&
+	    ad->submit_job == NULL &&
+	    strlen(elm_entry_entry_get(obj)) == BT_PK_MLEN)
+		ad->submit_job = ecore_job_add(__bluetooth_auto_submit_job_cb,
+					       ad);
+#endif
+}
+
+/* Passkeys take up to BT_PK_MLEN digits, PIN codes up to BT_PIN_MLEN
+   characters. The filters read these structs on every insert. */
+static void __bluetooth_set_input_filter(struct bt_popup_appdata *ad)
+{
+	if (ad->event_type == BT_EVENT_PASSKEY_REQUEST) {
+		ad->input_limit.max_char_count = BT_PK_MLEN;
+		ad->input_accept.accepted = "0123456789";
+	} else {
+		ad->input_limit.max_char_count = BT_PIN_MLEN;
+		ad->input_accept.accepted = NULL;
 	}
+
+	ad->input_limit.max_byte_count = 0;
+	ad->input_accept.rejected = NULL;
 }
 
 static void __bluetooth_entry_focused_cb(void *data, Evas_Object *obj,
@@ -574,65 +1864,249 @@ static void __bluetooth_check_chagned_cb(void *data, Evas_Object *obj,
         elm_entry_password_set(data, !state);
 }
 
-static void __bluetooth_draw_popup(struct bt_popup_appdata *ad,
+/* The clicked callback tells the buttons apart by their response, not by
+   their translated label */
+static Evas_Object *__bluetooth_add_popup_button(Evas_Object *parent,
+					Evas_Object *popup, const char *part,
+					bt_btn_response_t response)
+{
+	Evas_Object *btn;
+
+	btn = elm_button_add(parent);
+	elm_object_style_set(btn, "popup_button/default");
+	elm_object_part_content_set(popup, part, btn);
+	evas_object_data_set(btn, BT_BTN_RESPONSE_KEY,
+			     GINT_TO_POINTER(response));
+
+	return btn;
+}
+
+/* Rebind the click callback only when the template served another event */
+static void __bluetooth_template_bind(struct bt_popup_appdata *ad,
+				struct bt_popup_template *tpl,
+				bt_popup_btn_cb func)
+{
+	if (tpl->func == func)
+		return;
+
+	/* Added first, so the click is stamped before func replies */
+	if (tpl->func == NULL) {
+		if (tpl->btn1)
+			evas_object_smart_callback_add(tpl->btn1, "clicked",
+						__bluetooth_btn_trace_cb, ad);
+		if (tpl->btn2)
+			evas_object_smart_callback_add(tpl->btn2, "clicked",
+						__bluetooth_btn_trace_cb, ad);
+		if (tpl->btn3)
+			evas_object_smart_callback_add(tpl->btn3, "clicked",
+						__bluetooth_btn_trace_cb, ad);
+	}
+
+	if (tpl->btn1) {
+		if (tpl->func)
+			evas_object_smart_callback_del(tpl->btn1, "clicked",
+						       tpl->func);
+		evas_object_smart_callback_add(tpl->btn1, "clicked", func, ad);
+	}
+
+	if (tpl->btn2) {
+		if (tpl->func)
+			evas_object_smart_callback_del(tpl->btn2, "clicked",
+						       tpl->func);
+		evas_object_smart_callback_add(tpl->btn2, "clicked", func, ad);
+	}
+
+	if (tpl->btn3) {
+		if (tpl->func)
+			evas_object_smart_callback_del(tpl->btn3, "clicked",
+						       tpl->func);
+		evas_object_smart_callback_add(tpl->btn3, "clicked", func, ad);
+	}
+
+	tpl->func = func;
+}
+
+/* Note for the shown request where its template comes from, before it
+   is built or reused */
+static void __bluetooth_template_origin(struct bt_popup_appdata *ad,
+					struct bt_popup_template *tpl)
+{
+	if (ad->request) {
+		if (tpl->popup == NULL)
+			ad->request->origin = BT_TEMPLATE_BUILT;
+		else if (tpl->prewarmed)
+			ad->request->origin = BT_TEMPLATE_PREWARMED;
+		else
+			ad->request->origin = BT_TEMPLATE_REUSED;
+	}
+
+	tpl->prewarmed = EINA_FALSE;
+}
+
+static struct bt_popup_template *__bluetooth_get_popup_template(
+					struct bt_popup_appdata *ad,
+					bt_popup_layout_t layout)
+{
+	struct bt_popup_template *tpl = &ad->templates[layout];
+
+	if (tpl->popup) {
+		ad->obj_reused += tpl->obj_count;
+		return tpl;
+	}
+
+	tpl->popup = elm_popup_add(ad->win_main);
+	evas_object_size_hint_weight_set(tpl->popup, EVAS_HINT_EXPAND,
+					 EVAS_HINT_EXPAND);
+	tpl->dialog = tpl->popup;
+	tpl->obj_count = 1;
+
+	if (layout != BT_POPUP_LAYOUT_NONE) {
+		tpl->btn1 = __bluetooth_add_popup_button(tpl->popup,
+							 tpl->popup, "button1",
+							 BT_BTN_ACCEPT);
+		tpl->obj_count++;
+	}
+
+	if (layout == BT_POPUP_LAYOUT_TWO_BTN ||
+	    layout == BT_POPUP_LAYOUT_THREE_BTN) {
+		tpl->btn2 = __bluetooth_add_popup_button(tpl->popup,
+							 tpl->popup, "button2",
+							 BT_BTN_REJECT);
+		tpl->obj_count++;
+	}
+
+	if (layout == BT_POPUP_LAYOUT_THREE_BTN) {
+		tpl->btn3 = __bluetooth_add_popup_button(tpl->popup,
+							 tpl->popup, "button3",
+							 BT_BTN_ACCEPT_ALL);
+		tpl->obj_count++;
+	}
+
+	ad->obj_created += tpl->obj_count;
+
+	return tpl;
+}
+
+/* Compact mode: shrink win_main to the minimum geometry of the popup and
+   leave the placement to the window manager. The input view keeps the
+   whole screen, its conformant makes room for the keypad. */
+static void __bluetooth_fit_win(struct bt_popup_appdata *ad,
+				Eina_Bool fullscreen)
+{
+	Evas_Coord cur_w = 0;
+	Evas_Coord cur_h = 0;
+	Evas_Coord w = 0;
+	Evas_Coord h = 0;
+
+	if (!ad->compact || ad->win_main == NULL)
+		return;
+
+	if (fullscreen) {
+		ecore_x_window_size_get(ecore_x_window_root_first_get(),
+					&w, &h);
+	} else {
+		evas_smart_objects_calculate(evas_object_evas_get(ad->popup));
+		evas_object_size_hint_min_get(ad->popup, &w, &h);
+	}
+
+	if (w <= 0 || h <= 0)
+		return;
+
+	evas_object_geometry_get(ad->win_main, NULL, NULL, &cur_w, &cur_h);
+	if (w == cur_w && h == cur_h)
+		return;
+
+	evas_object_resize(ad->win_main, w, h);
+
+	bt_log_print(BT_POPUP, "Window %dx%d, ARGB buffer %d KB",
+		     w, h, w * h * 4 / 1024);
+}
+
+/* The templates are shared between event types, so the response of each
+   button is set from what it sends this time. button2 always rejects and
+   button3 accepts all. */
+static void __bluetooth_draw_popup_full(struct bt_popup_appdata *ad,
 			const char *title, char *btn1_text,
-			char *btn2_text, void (*func) (void *data,
+			bt_btn_response_t btn1_response,
+			char *btn2_text, char *btn3_text,
+			void (*func) (void *data,
 			Evas_Object *obj, void *event_info))
 {
 	char temp_str[BT_TITLE_STR_MAX_LEN+BT_TEXT_EXTRA_LEN] = { 0 };
+	struct bt_popup_template *tpl;
+	bt_popup_layout_t layout;
 	Ecore_X_Window xwin;
-	Evas_Object *btn1;
-	Evas_Object *btn2;
 
 	bt_log_print(BT_POPUP, "__bluetooth_draw_popup");
 
-	ad->popup = elm_popup_add(ad->win_main);
-	evas_object_size_hint_weight_set(ad->popup, EVAS_HINT_EXPAND,
-					 EVAS_HINT_EXPAND);
+	if ((btn1_text != NULL) && (btn2_text != NULL) && (btn3_text != NULL))
+		layout = BT_POPUP_LAYOUT_THREE_BTN;
+	else if ((btn1_text != NULL) && (btn2_text != NULL))
+		layout = BT_POPUP_LAYOUT_TWO_BTN;
+	else if (btn1_text != NULL)
+		layout = BT_POPUP_LAYOUT_ONE_BTN;
+	else
+		layout = BT_POPUP_LAYOUT_NONE;
 
-	if (title != NULL) {
+	__bluetooth_template_origin(ad, &ad->templates[layout]);
+	tpl = __bluetooth_get_popup_template(ad, layout);
+	ad->popup = tpl->popup;
+
+	if (title != NULL)
 		snprintf(temp_str, BT_TITLE_STR_MAX_LEN+BT_TEXT_EXTRA_LEN,
 			"<align=center>%s</align>", title);
-		elm_object_text_set(ad->popup, temp_str);
+
+	elm_object_text_set(ad->popup, temp_str);
+
+	if (tpl->btn1) {
+		elm_object_text_set(tpl->btn1, btn1_text);
+		evas_object_data_set(tpl->btn1, BT_BTN_RESPONSE_KEY,
+				     GINT_TO_POINTER(btn1_response));
 	}
 
-	if ((btn1_text != NULL) && (btn2_text != NULL)) {
-		btn1 = elm_button_add(ad->popup);
-		elm_object_style_set(btn1, "popup_button/default");
-		elm_object_text_set(btn1, btn1_text);
-		elm_object_part_content_set(ad->popup, "button1", btn1);
-		evas_object_smart_callback_add(btn1, "clicked", func, ad);
+	if (tpl->btn2) {
+		elm_object_text_set(tpl->btn2, btn2_text);
+		evas_object_data_set(tpl->btn2, BT_BTN_RESPONSE_KEY,
+				     GINT_TO_POINTER(BT_BTN_REJECT));
+	}
 
-		btn2 = elm_button_add(ad->popup);
-		elm_object_style_set(btn2, "popup_button/default");
-		elm_object_text_set(btn2, btn2_text);
-		elm_object_part_content_set(ad->popup, "button2", btn2);
-		evas_object_smart_callback_add(btn2, "clicked", func, ad);
-	} else if (btn1_text != NULL) {
-		btn1 = elm_button_add(ad->popup);
-		elm_object_style_set(btn1, "popup_button/default");
-		elm_object_text_set(btn1, btn1_text);
-		elm_object_part_content_set(ad->popup, "button1", btn1);
-		evas_object_smart_callback_add(btn1, "clicked", func, ad);
+	if (tpl->btn3) {
+		elm_object_text_set(tpl->btn3, btn3_text);
+		evas_object_data_set(tpl->btn3, BT_BTN_RESPONSE_KEY,
+				     GINT_TO_POINTER(BT_BTN_ACCEPT_ALL));
 	}
 
+	__bluetooth_template_bind(ad, tpl, func);
+
+	bt_log_print(BT_POPUP, "Evas objects created[%d] reused[%d]",
+		     ad->obj_created, ad->obj_reused);
+
+	__bluetooth_fit_win(ad, EINA_FALSE);
+
 	xwin = elm_win_xwindow_get(ad->popup);
 	ecore_x_netwm_window_type_set(xwin, ECORE_X_WINDOW_TYPE_NOTIFICATION);
 	utilx_set_system_notification_level(ecore_x_display_get(), xwin,
 				UTILX_NOTIFICATION_LEVEL_NORMAL);
 
 	evas_object_show(ad->popup);
+	__bluetooth_trace_mark(ad, BT_TRACE_POPUP_SHOW);
 	evas_object_show(ad->win_main);
 
 	bt_log_print(BT_POPUP, "__bluetooth_draw_popup END");
 }
 
-static void __bluetooth_draw_input_view(struct bt_popup_appdata *ad,
-			const char *title, const char *text,
-			void (*func)
-			(void *data, Evas_Object *obj, void *event_info))
+static void __bluetooth_draw_popup(struct bt_popup_appdata *ad,
+			const char *title, char *btn1_text,
+			char *btn2_text, void (*func) (void *data,
+			Evas_Object *obj, void *event_info))
+{
+	__bluetooth_draw_popup_full(ad, title, btn1_text, BT_BTN_ACCEPT,
+				    btn2_text, NULL, func);
+}
+
+static int __bluetooth_create_input_view(struct bt_popup_appdata *ad,
+					struct bt_popup_template *tpl)
 {
-	Ecore_X_Window xwin;
 	Evas_Object *conformant = NULL;
 	Evas_Object *content = NULL;
 	Evas_Object *passpopup = NULL;
@@ -641,32 +2115,30 @@ static void __bluetooth_draw_input_view(struct bt_popup_appdata *ad,
 	Evas_Object *editfield = NULL;
 	Evas_Object *entry = NULL;
 	Evas_Object *check = NULL;
-	Evas_Object *l_button = NULL;
-	Evas_Object *r_button = NULL;
-
-	if (ad == NULL || ad->win_main == NULL) {
-		bt_log_print(BT_POPUP, "Invalid parameter");
-		return;
+	gint64 start;
+
+	if (!ad->imf_initialized) {
+		start = g_get_monotonic_time();
+		ecore_imf_init();
+		ad->imf_initialized = EINA_TRUE;
+		bt_log_print(BT_POPUP, "IMF init in %lld us",
+			     (long long)(g_get_monotonic_time() - start));
 	}
 
 	conformant = elm_conformant_add(ad->win_main);
 	if (conformant == NULL) {
 		bt_log_print(BT_POPUP, "conformant is NULL");
-		return;
+		return -1;
 	}
-	ad->popup = conformant;
 
-	elm_win_conformant_set(ad->win_main, EINA_TRUE);
 	elm_win_resize_object_add(ad->win_main, conformant);
 	evas_object_size_hint_weight_set(conformant, EVAS_HINT_EXPAND, EVAS_HINT_EXPAND);
 	evas_object_size_hint_align_set(conformant, EVAS_HINT_FILL, EVAS_HINT_FILL);
-	evas_object_show(conformant);
 
 	content = elm_layout_add(conformant);
 	elm_object_content_set(conformant, content);
 
 	passpopup = elm_popup_add(content);
-	elm_object_part_text_set(passpopup, "title,text", title);
 
 	box = elm_box_add(passpopup);
 	evas_object_size_hint_weight_set(box, EVAS_HINT_EXPAND, EVAS_HINT_EXPAND);
@@ -675,7 +2147,6 @@ static void __bluetooth_draw_input_view(struct bt_popup_appdata *ad,
 
 	label = elm_label_add(box);
 	elm_object_style_set(label, "popup/default");
-	elm_object_text_set(label, text);
 	elm_label_line_wrap_set(label, ELM_WRAP_CHAR);
 	evas_object_size_hint_weight_set(label, EVAS_HINT_EXPAND, EVAS_HINT_EXPAND);
 	evas_object_size_hint_align_set(label, EVAS_HINT_FILL, EVAS_HINT_FILL);
@@ -686,14 +2157,11 @@ static void __bluetooth_draw_input_view(struct bt_popup_appdata *ad,
 	elm_layout_theme_set(editfield, "layout", "editfield", "default");
 	evas_object_size_hint_weight_set(editfield, EVAS_HINT_EXPAND, EVAS_HINT_EXPAND);
 	evas_object_size_hint_align_set(editfield, EVAS_HINT_FILL, EVAS_HINT_FILL);
-	ad->editfield = editfield;
 
 	entry = elm_entry_add(box);
 	elm_object_part_content_set(editfield, "elm.swallow.content", entry);
-	elm_object_part_text_set(editfield, "elm.text", text);
 	elm_entry_single_line_set(entry, EINA_TRUE);
 	elm_entry_scrollable_set(entry, EINA_TRUE);
-	ad->entry = entry;
 
 	evas_object_smart_callback_add(entry, "changed",
 				__bluetooth_entry_change_cb,
@@ -715,13 +2183,20 @@ static void __bluetooth_draw_input_view(struct bt_popup_appdata *ad,
 	elm_entry_input_panel_layout_set(entry,
 				ELM_INPUT_PANEL_LAYOUT_NUMBERONLY);
 
+	/* Owned by the entry, reused for every show and hide of the keypad */
+	ad->imf_context = elm_entry_imf_context_get(entry);
+
+	/* Reject extra or invalid input before it reaches the entry */
+	elm_entry_markup_filter_append(entry, elm_entry_filter_limit_size,
+				       &ad->input_limit);
+	elm_entry_markup_filter_append(entry, elm_entry_filter_accept_set,
+				       &ad->input_accept);
+
 	evas_object_show(entry);
 	evas_object_show(editfield);
-	elm_object_focus_set(entry, EINA_TRUE);
 	elm_box_pack_end(box, editfield);
 
 	check = elm_check_add(box);
-	elm_object_text_set(check, BT_STR_SHOW_PASSWORD);
 	elm_object_focus_allow_set(check, EINA_FALSE);
 	evas_object_size_hint_weight_set(check, EVAS_HINT_EXPAND,
 					EVAS_HINT_EXPAND);
@@ -734,276 +2209,918 @@ static void __bluetooth_draw_input_view(struct bt_popup_appdata *ad,
 
 	elm_object_content_set(passpopup, box);
 
-	l_button = elm_button_add(ad->win_main);
-	elm_object_style_set(l_button, "popup_button/default");
-	elm_object_text_set(l_button, BT_STR_OK);
-	elm_object_part_content_set(passpopup, "button1", l_button);
-	evas_object_smart_callback_add(l_button, "clicked", func, ad);
-	elm_object_disabled_set(l_button, EINA_TRUE);
+	tpl->btn1 = __bluetooth_add_popup_button(ad->win_main, passpopup,
+						 "button1", BT_BTN_ACCEPT);
+
+	tpl->btn2 = __bluetooth_add_popup_button(ad->win_main, passpopup,
+						 "button2", BT_BTN_REJECT);
+
+	/* Shown by __bluetooth_draw_input_view, the template may be built
+	   while another popup is on screen */
+
+	tpl->popup = conformant;
+	tpl->dialog = passpopup;
+	tpl->label = label;
+	tpl->editfield = editfield;
+	tpl->entry = entry;
+	tpl->check = check;
+	tpl->obj_count = 10;
+
+	ad->obj_created += tpl->obj_count;
+
+	return 0;
+}
+
+static void __bluetooth_draw_input_view(struct bt_popup_appdata *ad,
+			const char *title, const char *text,
+			void (*func)
+			(void *data, Evas_Object *obj, void *event_info))
+{
+	struct bt_popup_template *tpl;
+	Ecore_X_Window xwin;
+
+	if (ad == NULL || ad->win_main == NULL) {
+		bt_log_print(BT_POPUP, "Invalid parameter");
+		return;
+	}
+
+	tpl = &ad->templates[BT_POPUP_LAYOUT_INPUT];
+	__bluetooth_template_origin(ad, tpl);
+
+	if (tpl->popup == NULL) {
+		if (__bluetooth_create_input_view(ad, tpl) < 0)
+			return;
+	} else {
+		ad->obj_reused += tpl->obj_count;
+	}
+
+	ad->popup = tpl->popup;
+	ad->editfield = tpl->editfield;
+	ad->entry = tpl->entry;
+	ad->edit_field_save_btn = tpl->btn1;
+
+	elm_win_conformant_set(ad->win_main, EINA_TRUE);
+
+	elm_object_part_text_set(tpl->dialog, "title,text", title);
+	elm_object_text_set(tpl->label, text);
+	elm_object_part_text_set(tpl->editfield, "elm.text", text);
+
+	/* Set on every use, the language may have changed */
+	elm_object_text_set(tpl->check, BT_STR_SHOW_PASSWORD);
+	elm_object_text_set(tpl->btn1, BT_STR_OK);
+	elm_object_text_set(tpl->btn2, BT_STR_CANCEL);
+
+	__bluetooth_set_input_filter(ad);
+
+	/* Undo what the previous request left in the reused view */
+	elm_entry_entry_set(tpl->entry, "");
+	elm_entry_password_set(tpl->entry, EINA_TRUE);
+	elm_check_state_set(tpl->check, EINA_FALSE);
+	elm_object_signal_emit(tpl->editfield, "elm,state,eraser,hide", "elm");
+	elm_object_disabled_set(tpl->btn1, EINA_TRUE);
 
-	ad->edit_field_save_btn = l_button;
+	__bluetooth_template_bind(ad, tpl, func);
 
-	r_button = elm_button_add(ad->win_main);
-	elm_object_style_set(r_button, "popup_button/default");
-	elm_object_text_set(r_button, BT_STR_CANCEL);
-	elm_object_part_content_set(passpopup, "button2", r_button);
-	evas_object_smart_callback_add(r_button, "clicked", func, ad);
-	evas_object_show(passpopup);
+	bt_log_print(BT_POPUP, "Evas objects created[%d] reused[%d]",
+		     ad->obj_created, ad->obj_reused);
 
-	xwin = elm_win_xwindow_get(conformant);
+	elm_object_focus_set(tpl->entry, EINA_TRUE);
+	if (ad->imf_context)
+		ecore_imf_context_input_panel_show(ad->imf_context);
+
+	__bluetooth_fit_win(ad, EINA_TRUE);
+
+	xwin = elm_win_xwindow_get(ad->popup);
 	ecore_x_netwm_window_type_set(xwin, ECORE_X_WINDOW_TYPE_NOTIFICATION);
 	utilx_set_system_notification_level(ecore_x_display_get(), xwin,
 				UTILX_NOTIFICATION_LEVEL_NORMAL);
 
+	evas_object_show(tpl->dialog);
 	evas_object_show(ad->popup);
+	__bluetooth_trace_mark(ad, BT_TRACE_POPUP_SHOW);
 	evas_object_show(ad->win_main);
 }
 
 static void __bluetooth_delete_input_view(struct bt_popup_appdata *ad)
 {
-	__bluetooth_ime_hide();
+	__bluetooth_ime_hide(ad);
+}
+
+static int __bluetooth_render_input(struct bt_popup_appdata *ad,
+				    struct bt_popup_request *req)
+{
+	char view_title[BT_TITLE_STR_MAX_LEN] = { 0 };
+	char text[BT_GLOBALIZATION_STR_LENGTH] = { 0 };
+	char *conv_str = NULL;
+
+	if (req->data.device_name)
+		conv_str = elm_entry_utf8_to_markup(req->data.device_name);
+
+	snprintf(view_title, BT_TITLE_STR_MAX_LEN,
+		 "%s", BT_STR_BLUETOOTH_PAIRING_REQUEST);
+
+	snprintf(text, BT_GLOBALIZATION_STR_LENGTH,
+		 BT_STR_ENTER_PIN_TO_PAIR, conv_str);
+
+	if (conv_str)
+		free(conv_str);
+
+	/* Request user inputted PIN / Passkey for basic pairing */
+	__bluetooth_draw_input_view(ad, view_title, text,
+				  __bluetooth_input_request_cb);
+
+	return 0;
+}
+
+static int __bluetooth_render_passkey_confirm(struct bt_popup_appdata *ad,
+					      struct bt_popup_request *req)
+{
+	char view_title[BT_TITLE_STR_MAX_LEN] = { 0 };
+	char *conv_str = NULL;
+
+	if (!req->data.device_name || !req->data.passkey) {
+		req->timeout = BT_ERROR_TIMEOUT;
+		return 0;
+	}
+
+	conv_str = elm_entry_utf8_to_markup(req->data.device_name);
+
+	snprintf(view_title, BT_TITLE_STR_MAX_LEN,
+		 BT_STR_CONFIRM_PASSKEY_PS_TO_PAIR_WITH_PS,
+		 conv_str, req->data.passkey);
+
+	bt_log_print(BT_POPUP, "title: %s", view_title);
+
+	if (conv_str)
+		free(conv_str);
+
+	__bluetooth_draw_popup(ad, view_title,
+			BT_STR_OK, BT_STR_CANCEL,
+			__bluetooth_passkey_confirm_cb);
+
+	return 0;
+}
+
+static int __bluetooth_render_passkey_display(struct bt_popup_appdata *ad,
+					      struct bt_popup_request *req)
+{
+	/* Nothing to do */
+	return 0;
+}
+
+static int __bluetooth_render_authorize(struct bt_popup_appdata *ad,
+					struct bt_popup_request *req)
+{
+	char view_title[BT_TITLE_STR_MAX_LEN] = { 0 };
+	char *conv_str = NULL;
+
+	if (req->data.device_name)
+		conv_str = elm_entry_utf8_to_markup(req->data.device_name);
+
+	snprintf(view_title, BT_TITLE_STR_MAX_LEN,
+		 BT_STR_ALLOW_PS_TO_CONNECT_Q, conv_str);
+
+	if (conv_str)
+		free(conv_str);
+
+	__bluetooth_draw_popup(ad, view_title, BT_STR_YES, BT_STR_NO,
+			     __bluetooth_authorization_request_cb);
+
+	return 0;
+}
+
+static int __bluetooth_render_app_confirm(struct bt_popup_appdata *ad,
+					  struct bt_popup_request *req)
+{
+	const char *title = req->data.title;
+	const char *type = req->data.type;
+
+	bt_log_print(BT_POPUP, "app-confirm-request");
+
+	if (strcasecmp(type, "twobtn") == 0) {
+		__bluetooth_draw_popup(ad, title, BT_STR_YES, BT_STR_NO,
+				     __bluetooth_app_confirm_cb);
+	} else if (strcasecmp(type, "onebtn") == 0) {
+		req->timeout = BT_NOTIFICATION_TIMEOUT;
+		__bluetooth_draw_popup(ad, title, BT_STR_YES, NULL,
+				     __bluetooth_app_confirm_cb);
+	}
+
+	/* "none" is posted to the ticker, see __bluetooth_is_ticker */
+
+	return 0;
+}
+
+static int __bluetooth_render_push_authorize(struct bt_popup_appdata *ad,
+					     struct bt_popup_request *req)
+{
+	char view_title[BT_TITLE_STR_MAX_LEN] = { 0 };
+	char *conv_str = NULL;
+
+	if (req->data.device_name)
+		conv_str = elm_entry_utf8_to_markup(req->data.device_name);
+
+	snprintf(view_title, BT_TITLE_STR_MAX_LEN,
+		 BT_STR_RECEIVE_PS_FROM_PS_Q, req->data.file, conv_str);
+
+	if (conv_str)
+		free(conv_str);
+
+	/* A grant needs the device address, see __bluetooth_add_obex_grant */
+	__bluetooth_draw_popup_full(ad, view_title, BT_STR_YES, BT_BTN_ACCEPT,
+			BT_STR_NO, req->data.device_address ?
+			BT_STR_ACCEPT_ALL : NULL,
+			__bluetooth_push_authorization_request_cb);
+
+	return 0;
+}
+
+static int __bluetooth_render_confirm_overwrite(struct bt_popup_appdata *ad,
+						struct bt_popup_request *req)
+{
+	char view_title[BT_TITLE_STR_MAX_LEN] = { 0 };
+
+	snprintf(view_title, BT_TITLE_STR_MAX_LEN,
+		 BT_STR_OVERWRITE_FILE_Q, req->data.file);
+
+	__bluetooth_draw_popup_full(ad, view_title, BT_STR_YES, BT_BTN_ACCEPT,
+			BT_STR_NO, req->data.device_address ?
+			BT_STR_APPLY_TO_ALL : NULL,
+			__bluetooth_confirm_overwrite_request_cb);
+
+	return 0;
+}
+
+static int __bluetooth_render_keyboard_passkey(struct bt_popup_appdata *ad,
+					       struct bt_popup_request *req)
+{
+	char view_title[BT_TITLE_STR_MAX_LEN] = { 0 };
+	char *conv_str = NULL;
+
+	if (!req->data.device_name || !req->data.passkey) {
+		req->timeout = BT_ERROR_TIMEOUT;
+		return 0;
+	}
+
+	conv_str = elm_entry_utf8_to_markup(req->data.device_name);
+
+	snprintf(view_title, BT_TITLE_STR_MAX_LEN,
+		 BT_STR_ENTER_PS_ON_PS_TO_PAIR, req->data.passkey, conv_str);
+
+	bt_log_print(BT_POPUP, "title: %s", view_title);
+
+	if (conv_str)
+		free(conv_str);
+
+	__bluetooth_draw_popup_full(ad, view_title, BT_STR_CANCEL,
+			BT_BTN_CANCEL, NULL, NULL,
+			__bluetooth_input_cancel_cb);
+
+	return 0;
+}
+
+static int __bluetooth_render_information(struct bt_popup_appdata *ad,
+					  struct bt_popup_request *req)
+{
+	const char *title = req->data.title;
+	const char *type = req->data.type;
+
+	bt_log_print(BT_POPUP, "bt-information");
+
+	if (strlen(title) > 255)
+		return -1;
+
+	/* "none" is posted to the ticker, see __bluetooth_is_ticker */
+	if (strcasecmp(type, "onebtn") == 0) {
+		__bluetooth_draw_popup(ad, title, BT_STR_OK, NULL,
+				     __bluetooth_app_confirm_cb);
+	}
+
+	return 0;
+}
+
+static int __bluetooth_render_exchange(struct bt_popup_appdata *ad,
+				       struct bt_popup_request *req)
+{
+	char view_title[BT_TITLE_STR_MAX_LEN] = { 0 };
+	char *conv_str = NULL;
+
+	if (req->data.device_name)
+		conv_str = elm_entry_utf8_to_markup(req->data.device_name);
+
+	snprintf(view_title, BT_TITLE_STR_MAX_LEN,
+		 BT_STR_EXCHANGE_OBJECT_WITH_PS_Q, conv_str);
+
+	if (conv_str)
+		free(conv_str);
+
+	__bluetooth_draw_popup(ad, view_title, BT_STR_YES, BT_STR_NO,
+			     __bluetooth_authorization_request_cb);
+
+	return 0;
+}
+
+#define BT_REPLY_NONE { BT_REPLY_KIND_NONE, BT_PROXY_AGENT, 0 }
+#define BT_REPLY_SIGNAL { BT_REPLY_KIND_SIGNAL, BT_PROXY_AGENT, 0 }
+#define BT_REPLY(proxy, method) { BT_REPLY_KIND_METHOD, proxy, method }
+
+static const struct bt_event_desc bt_event_table[] = {
+	{
+		.name = "pin-request",
+		.event_type = BT_EVENT_PIN_REQUEST,
+		.priority = BT_REQUEST_PRIORITY_AUTHENTICATION,
+		.required_keys = BT_BUNDLE_KEY_DEVICE_NAME,
+		.timeout = BT_AUTHENTICATION_TIMEOUT,
+		.render = __bluetooth_render_input,
+		.accept = BT_REPLY(BT_PROXY_AGENT, BT_REPLY_PIN_CODE),
+		.cancel = BT_REPLY(BT_PROXY_AGENT, BT_REPLY_PIN_CODE),
+	}, {
+		.name = "passkey-confirm-request",
+		.event_type = BT_EVENT_PASSKEY_CONFIRM_REQUEST,
+		.priority = BT_REQUEST_PRIORITY_AUTHENTICATION,
+		.timeout = BT_AUTHENTICATION_TIMEOUT,
+		.render = __bluetooth_render_passkey_confirm,
+		.accept = BT_REPLY(BT_PROXY_AGENT, BT_REPLY_CONFIRMATION),
+		.cancel = BT_REPLY(BT_PROXY_AGENT, BT_REPLY_CONFIRMATION),
+	}, {
+		.name = "passkey-request",
+		.event_type = BT_EVENT_PASSKEY_REQUEST,
+		.priority = BT_REQUEST_PRIORITY_AUTHENTICATION,
+		.required_keys = BT_BUNDLE_KEY_DEVICE_NAME,
+		.timeout = BT_AUTHENTICATION_TIMEOUT,
+		.render = __bluetooth_render_input,
+		.accept = BT_REPLY(BT_PROXY_AGENT, BT_REPLY_PASSKEY),
+		.cancel = BT_REPLY(BT_PROXY_AGENT, BT_REPLY_PASSKEY),
+	}, {
+		.name = "passkey-display-request",
+		.event_type = BT_EVENT_PASSKEY_DISPLAY_REQUEST,
+		.priority = BT_REQUEST_PRIORITY_AUTHENTICATION,
+		.timeout = 0,
+		.render = __bluetooth_render_passkey_display,
+		.accept = BT_REPLY_NONE,
+		.cancel = BT_REPLY_NONE,
+	}, {
+		.name = "authorize-request",
+		.policy = EINA_TRUE,
+		.event_type = BT_EVENT_AUTHORIZE_REQUEST,
+		.priority = BT_REQUEST_PRIORITY_AUTHORIZATION,
+		.required_keys = BT_BUNDLE_KEY_DEVICE_NAME,
+		.timeout = BT_AUTHORIZATION_TIMEOUT,
+		.render = __bluetooth_render_authorize,
+		.accept = BT_REPLY(BT_PROXY_AGENT, BT_REPLY_AUTHORIZE),
+		.cancel = BT_REPLY(BT_PROXY_AGENT, BT_REPLY_AUTHORIZE),
+	}, {
+		.name = "app-confirm-request",
+		.event_type = BT_EVENT_APP_CONFIRM_REQUEST,
+		.priority = BT_REQUEST_PRIORITY_AUTHORIZATION,
+		.required_keys = BT_BUNDLE_KEY_TITLE | BT_BUNDLE_KEY_TYPE,
+		.timeout = BT_AUTHORIZATION_TIMEOUT,
+		.render = __bluetooth_render_app_confirm,
+		.ticker = EINA_TRUE,
+		.accept = BT_REPLY_SIGNAL,
+		.cancel = BT_REPLY_SIGNAL,
+	}, {
+		.name = "push-authorize-request",
+		.policy = EINA_TRUE,
+		.event_type = BT_EVENT_PUSH_AUTHORIZE_REQUEST,
+		.priority = BT_REQUEST_PRIORITY_AUTHORIZATION,
+		.required_keys = BT_BUNDLE_KEY_DEVICE_NAME |
+				 BT_BUNDLE_KEY_FILE,
+		.timeout = BT_AUTHORIZATION_TIMEOUT,
+		.render = __bluetooth_render_push_authorize,
+		.accept = BT_REPLY(BT_PROXY_OBEX, BT_REPLY_AUTHORIZE),
+		.cancel = BT_REPLY(BT_PROXY_OBEX, BT_REPLY_AUTHORIZE),
+	}, {
+		.name = "confirm-overwrite-request",
+		.event_type = BT_EVENT_CONFIRM_OVERWRITE_REQUEST,
+		.priority = BT_REQUEST_PRIORITY_AUTHORIZATION,
+		.required_keys = BT_BUNDLE_KEY_FILE,
+		.timeout = BT_AUTHORIZATION_TIMEOUT,
+		.render = __bluetooth_render_confirm_overwrite,
+		.accept = BT_REPLY(BT_PROXY_OBEX, BT_REPLY_OVERWRITE),
+		.cancel = BT_REPLY(BT_PROXY_OBEX, BT_REPLY_OVERWRITE),
+	}, {
+		.name = "keyboard-passkey-request",
+		.event_type = BT_EVENT_KEYBOARD_PASSKEY_REQUEST,
+		.priority = BT_REQUEST_PRIORITY_AUTHENTICATION,
+		.timeout = BT_AUTHENTICATION_TIMEOUT,
+		.render = __bluetooth_render_keyboard_passkey,
+		.accept = BT_REPLY_NONE,
+		.cancel = BT_REPLY(BT_PROXY_AGENT, BT_REPLY_PASSKEY),
+	}, {
+		.name = "bt-information",
+		.event_type = BT_EVENT_INFORMATION,
+		.priority = BT_REQUEST_PRIORITY_INFORMATION,
+		.required_keys = BT_BUNDLE_KEY_TITLE | BT_BUNDLE_KEY_TYPE,
+		.timeout = BT_NOTIFICATION_TIMEOUT,
+		.render = __bluetooth_render_information,
+		.ticker = EINA_TRUE,
+		.accept = BT_REPLY_SIGNAL,
+		.cancel = BT_REPLY_NONE,
+	}, {
+		.name = "exchange-request",
+		.policy = EINA_TRUE,
+		.event_type = BT_EVENT_EXCHANGE_REQUEST,
+		.priority = BT_REQUEST_PRIORITY_AUTHORIZATION,
+		.required_keys = BT_BUNDLE_KEY_DEVICE_NAME,
+		.timeout = BT_AUTHORIZATION_TIMEOUT,
+		.render = __bluetooth_render_exchange,
+		.accept = BT_REPLY(BT_PROXY_AGENT, BT_REPLY_AUTHORIZE),
+		.cancel = BT_REPLY(BT_PROXY_OBEX, BT_REPLY_AUTHORIZE),
+	},
+};
+
+G_STATIC_ASSERT(G_N_ELEMENTS(bt_event_table) <= BT_EVENT_DESC_MAX);
+
+#define BT_EVENT_NAME_MAX 32
+
+/* Event type name to descriptor, built on first lookup */
+static GHashTable *bt_event_hash;
+
+static const struct bt_event_desc *__bluetooth_find_event_desc(
+						const char *event_type)
+{
+	char name[BT_EVENT_NAME_MAX] = { 0 };
+	int i;
+
+	if (event_type == NULL || strlen(event_type) >= BT_EVENT_NAME_MAX)
+		return NULL;
+
+	if (bt_event_hash == NULL) {
+		bt_event_hash = g_hash_table_new(g_str_hash, g_str_equal);
+
+		for (i = 0; i < G_N_ELEMENTS(bt_event_table); i++)
+			g_hash_table_insert(bt_event_hash,
+					    (gpointer)bt_event_table[i].name,
+					    (gpointer)&bt_event_table[i]);
+	}
+
+	/* Event type names are matched case-insensitively */
+	for (i = 0; event_type[i] != '\0'; i++)
+		name[i] = g_ascii_tolower(event_type[i]);
+
+	return g_hash_table_lookup(bt_event_hash, name);
+}
+
+#if defined(BT_MEM_ACCOUNTING) || defined(BT_BENCHMARK)
+static int __bluetooth_count_objects(Evas_Object *obj)
+{
+	Eina_List *members;
+	Evas_Object *member;
+	int count = 1;
+
+	members = evas_object_smart_members_get(obj);
+	EINA_LIST_FREE(members, member)
+		count += __bluetooth_count_objects(member);
+
+	return count;
+}
+
+static void __bluetooth_mem_sample(struct bt_popup_appdata *ad,
+				   struct bt_mem_sample *sample)
+{
+	struct mallinfo mi = mallinfo();
+	Evas_Object *obj;
+	Evas *evas;
+	int w = 0;
+	int h = 0;
+
+	memset(sample, 0x0, sizeof(struct bt_mem_sample));
+
+	if (ad->win_main) {
+		evas = evas_object_evas_get(ad->win_main);
+
+		for (obj = evas_object_bottom_get(evas); obj;
+		     obj = evas_object_above_get(obj))
+			sample->objects += __bluetooth_count_objects(obj);
+
+		evas_output_size_get(evas, &w, &h);
+		sample->buffer_kb = (long)w * h * 4 / 1024;
+	}
+
+	sample->heap_kb = mi.uordblks / 1024;
+	sample->rss_kb = __bluetooth_get_rss_kb();
 }
+#endif
 
-/* AUL bundle handler */
-static int __bluetooth_launch_handler(struct bt_popup_appdata *ad,
-			     void *reset_data, const char *event_type)
+#ifdef BT_MEM_ACCOUNTING
+/* Sample the memory of the shown request, when drawn or when answered */
+static void __bluetooth_mem_account(struct bt_popup_appdata *ad,
+				    gboolean teardown)
 {
-	bundle *kb = (bundle *) reset_data;
-	char view_title[BT_TITLE_STR_MAX_LEN] = { 0 };
-	char text[BT_GLOBALIZATION_STR_LENGTH] = { 0 };
-	int timeout = 0;
-	const char *device_name = NULL;
-	const char *passkey = NULL;
-	const char *file = NULL;
-	char *conv_str = NULL;
+	struct bt_mem_stats *stats;
+	struct bt_mem_sample *sample;
+	const struct bt_event_desc *desc;
 
-	bt_log_print(BT_POPUP, "__bluetooth_launch_handler");
+	if (ad->request == NULL)
+		return;
 
-	if (!reset_data || !event_type)
-		return -1;
+	desc = ad->request->desc;
+	stats = &ad->mem_stats[desc - bt_event_table];
+	sample = teardown ? &stats->teardown : &stats->show;
 
-	if (!strcasecmp(event_type, "pin-request")) {
-		timeout = BT_AUTHENTICATION_TIMEOUT;
+	__bluetooth_mem_sample(ad, sample);
 
-		device_name = bundle_get_val(kb, "device-name");
+	if (!teardown)
+		stats->count++;
 
-		if (device_name)
-			conv_str = elm_entry_utf8_to_markup(device_name);
+	if (sample->rss_kb > stats->rss_peak_kb)
+		stats->rss_peak_kb = sample->rss_kb;
 
-		snprintf(view_title, BT_TITLE_STR_MAX_LEN,
-			 "%s", BT_STR_BLUETOOTH_PAIRING_REQUEST);
+	bt_log_print(BT_POPUP, "mem %s %s: objects[%d] buffer[%ld KB] "
+		     "heap[%ld KB] rss[%ld KB]", desc->name,
+		     teardown ? "teardown" : "show", sample->objects,
+		     sample->buffer_kb, sample->heap_kb, sample->rss_kb);
+}
+
+static void __bluetooth_append_mem_sample(GString *str, const char *name,
+					  struct bt_mem_sample *sample)
+{
+	g_string_append_printf(str, "\"%s\":{\"objects\":%d,"
+			       "\"buffer_kb\":%ld,\"heap_kb\":%ld,"
+			       "\"rss_kb\":%ld}", name, sample->objects,
+			       sample->buffer_kb, sample->heap_kb,
+			       sample->rss_kb);
+}
 
-		snprintf(text, BT_GLOBALIZATION_STR_LENGTH,
-			 BT_STR_ENTER_PIN_TO_PAIR, conv_str);
+/* JSON object with the accounting of every event type shown so far */
+static char *__bluetooth_get_mem_stats(struct bt_popup_appdata *ad)
+{
+	struct bt_mem_stats *stats;
+	GString *str;
+	gboolean first = TRUE;
+	int i;
+
+	str = g_string_new("{");
+
+	for (i = 0; i < G_N_ELEMENTS(bt_event_table); i++) {
+		stats = &ad->mem_stats[i];
+		if (stats->count == 0)
+			continue;
+
+		g_string_append_printf(str, "%s\"%s\":{\"count\":%u,"
+				       "\"rss_peak_kb\":%ld,",
+				       first ? "" : ",",
+				       bt_event_table[i].name, stats->count,
+				       stats->rss_peak_kb);
+		__bluetooth_append_mem_sample(str, "show", &stats->show);
+		g_string_append_c(str, ',');
+		__bluetooth_append_mem_sample(str, "teardown",
+					      &stats->teardown);
+		g_string_append_c(str, '}');
+		first = FALSE;
+	}
 
-		if (conv_str)
-			free(conv_str);
+	g_string_append_c(str, '}');
 
-		/* Request user inputted PIN for basic pairing */
-		__bluetooth_draw_input_view(ad, view_title, text,
-					  __bluetooth_input_request_cb);
-	} else if (!strcasecmp(event_type, "passkey-confirm-request")) {
-		timeout = BT_AUTHENTICATION_TIMEOUT;
+	return g_string_free(str, FALSE);
+}
+#endif
 
-		device_name = bundle_get_val(kb, "device-name");
-		passkey = bundle_get_val(kb, "passkey");
+/* Latencies and outcome of a finished request */
+static void __bluetooth_account_request(struct bt_popup_request *req)
+{
+	struct bt_event_stats *stats;
+	gint64 *trace = req->trace;
+	gint64 shown;
+	gint64 answered;
 
-		if (device_name && passkey) {
-			conv_str = elm_entry_utf8_to_markup(device_name);
+	stats = bt_recorder_stats(req->event_type);
+	if (stats == NULL)
+		return;
 
-			snprintf(view_title, BT_TITLE_STR_MAX_LEN,
-			     BT_STR_CONFIRM_PASSKEY_PS_TO_PAIR_WITH_PS,
-			     conv_str, passkey);
+	stats->count++;
 
-			bt_log_print(BT_POPUP, "title: %s", view_title);
+	shown = trace[BT_TRACE_FIRST_FRAME];
+	answered = trace[BT_TRACE_USER_RESPONSE];
 
-			if (conv_str)
-				free(conv_str);
+	if (shown)
+		bt_histogram_add(&stats->visible,
+				 shown - trace[BT_TRACE_RESET]);
 
-			__bluetooth_draw_popup(ad, view_title,
-					BT_STR_OK, BT_STR_CANCEL,
-					__bluetooth_passkey_confirm_cb);
-		} else {
-			timeout = BT_ERROR_TIMEOUT;
-		}
-	} else if (!strcasecmp(event_type, "passkey-request")) {
-		const char *device_name = NULL;
+	if (shown && answered)
+		bt_histogram_add(&stats->decision, answered - shown);
 
-		timeout = BT_AUTHENTICATION_TIMEOUT;
+	/* The reply latency is taken when the agent acknowledges it */
 
-		device_name = bundle_get_val(kb, "device-name");
+	switch (req->response) {
+	case BT_RECORD_RESPONSE_ACCEPT:
+	case BT_RECORD_RESPONSE_ACCEPT_ALL:
+		stats->accept++;
+		break;
 
-		if (device_name)
-			conv_str = elm_entry_utf8_to_markup(device_name);
+	case BT_RECORD_RESPONSE_REJECT:
+		stats->reject++;
+		break;
 
-		snprintf(view_title, BT_TITLE_STR_MAX_LEN,
-			 "%s", BT_STR_BLUETOOTH_PAIRING_REQUEST);
+	case BT_RECORD_RESPONSE_CANCEL:
+		if (req->reason == BT_RECORD_TIMEOUT ||
+		    req->reason == BT_RECORD_EXPIRED)
+			stats->timeout++;
+		else
+			stats->cancel++;
+		break;
 
-		snprintf(text, BT_GLOBALIZATION_STR_LENGTH,
-			 BT_STR_ENTER_PIN_TO_PAIR, conv_str);
+	default:
+		break;
+	}
+}
 
-		if (conv_str)
-			free(conv_str);
+static void __bluetooth_append_hist(GString *str, const char *name,
+				    const struct bt_histogram *hist)
+{
+	int i;
+
+	g_string_append_printf(str, "\"%s\":{\"count\":%u,"
+			       "\"mean_us\":%lld,\"p50_us\":%lld,"
+			       "\"p99_us\":%lld,\"max_us\":%lld,"
+			       "\"buckets\":[", name, hist->count,
+			       hist->count ? (long long)(hist->total_us /
+							 hist->count) : 0,
+			       (long long)bt_histogram_percentile(hist, 50),
+			       (long long)bt_histogram_percentile(hist, 99),
+			       (long long)hist->max_us);
+
+	for (i = 0; i < BT_HIST_BUCKETS; i++)
+		g_string_append_printf(str, "%s%u", i ? "," : "",
+				       hist->buckets[i]);
+
+	g_string_append(str, "]}");
+}
 
-		/* Request user inputted Passkey for basic pairing */
-		__bluetooth_draw_input_view(ad, view_title, text,
-					  __bluetooth_input_request_cb);
+/* JSON object with the latencies and outcomes of every event type seen
+   since the recorder file was created or the last ResetStats */
+static char *__bluetooth_get_event_stats(void)
+{
+	const struct bt_event_stats *stats;
+	GString *str;
+	gboolean first = TRUE;
+	int i;
+
+	str = g_string_new("{");
+
+	for (i = 0; i < G_N_ELEMENTS(bt_event_table); i++) {
+		stats = bt_recorder_stats(bt_event_table[i].event_type);
+		if (stats == NULL ||
+		    (stats->count == 0 && stats->create_failed == 0))
+			continue;
+
+		g_string_append_printf(str, "%s\"%s\":{\"count\":%u,"
+				       "\"accept\":%u,\"reject\":%u,"
+				       "\"cancel\":%u,\"timeout\":%u,"
+				       "\"create_failed\":%u,",
+				       first ? "" : ",",
+				       bt_event_table[i].name, stats->count,
+				       stats->accept, stats->reject,
+				       stats->cancel, stats->timeout,
+				       stats->create_failed);
+		__bluetooth_append_hist(str, "visible", &stats->visible);
+		g_string_append_c(str, ',');
+		__bluetooth_append_hist(str, "decision", &stats->decision);
+		g_string_append_c(str, ',');
+		__bluetooth_append_hist(str, "reply", &stats->reply);
+		g_string_append_c(str, '}');
+		first = FALSE;
+	}
 
-	} else if (!strcasecmp(event_type, "passkey-display-request")) {
-		/* Nothing to do */
-	} else if (!strcasecmp(event_type, "authorize-request")) {
-		timeout = BT_AUTHORIZATION_TIMEOUT;
+	g_string_append_c(str, '}');
 
-		device_name = bundle_get_val(kb, "device-name");
+	return g_string_free(str, FALSE);
+}
 
-		if (device_name)
-			conv_str = elm_entry_utf8_to_markup(device_name);
+#ifdef BT_BENCHMARK
+/* Soak run of the benchmark: a request as the key and value strings of its
+   bundle, for the running process instead of a new launch */
+static void __bluetooth_bench_request(struct bt_popup_appdata *ad,
+				      DBusMessage *msg)
+{
+	char **args = NULL;
+	int count = 0;
+	bundle *b;
+	int i;
+
+	if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_ARRAY,
+				   DBUS_TYPE_STRING, &args, &count,
+				   DBUS_TYPE_INVALID))
+		return;
 
-		snprintf(view_title, BT_TITLE_STR_MAX_LEN,
-			 BT_STR_ALLOW_PS_TO_CONNECT_Q, conv_str);
+	b = bundle_create();
+	if (b) {
+		for (i = 0; i + 1 < count; i += 2)
+			bundle_add(b, args[i], args[i + 1]);
 
-		if (conv_str)
-			free(conv_str);
+		__bluetooth_reset(b, ad);
+		bundle_free(b);
+	}
 
-		__bluetooth_draw_popup(ad, view_title, BT_STR_YES, BT_STR_NO,
-				     __bluetooth_authorization_request_cb);
-	} else if (!strcasecmp(event_type, "app-confirm-request")) {
-		bt_log_print(BT_POPUP, "app-confirm-request");
-		timeout = BT_AUTHORIZATION_TIMEOUT;
+	dbus_free_string_array(args);
+}
 
-		const char *title = NULL;
-		const char *type = NULL;
+/* Memory of the process right now, for the soak run between requests */
+static char *__bluetooth_bench_get_sample(struct bt_popup_appdata *ad)
+{
+	struct bt_mem_sample sample;
 
-		title = bundle_get_val(kb, "title");
-		type = bundle_get_val(kb, "type");
+	__bluetooth_mem_sample(ad, &sample);
 
-		if (!title)
-			return -1;
+	return g_strdup_printf("{\"objects\":%d,\"heap_kb\":%ld,"
+			       "\"rss_kb\":%ld}", sample.objects,
+			       sample.heap_kb, sample.rss_kb);
+}
+#endif
 
-		if (strcasecmp(type, "twobtn") == 0) {
-			__bluetooth_draw_popup(ad, title, BT_STR_YES, BT_STR_NO,
-					     __bluetooth_app_confirm_cb);
-		} else if (strcasecmp(type, "onebtn") == 0) {
-			timeout = BT_NOTIFICATION_TIMEOUT;
-			__bluetooth_draw_popup(ad, title, BT_STR_YES, NULL,
-					     __bluetooth_app_confirm_cb);
-		} else if (strcasecmp(type, "none") == 0) {
-			timeout = BT_NOTIFICATION_TIMEOUT;
-			__bluetooth_draw_popup(ad, title, NULL, NULL,
-					     __bluetooth_app_confirm_cb);
-		}
-	} else if (!strcasecmp(event_type, "push-authorize-request")) {
-		timeout = BT_AUTHORIZATION_TIMEOUT;
+static DBusHandlerResult __bluetooth_stats_message_cb(DBusConnection *conn,
+						      DBusMessage *msg,
+						      void *data)
+{
+	DBusMessage *reply;
+	char *stats = NULL;
+
+#ifdef BT_MEM_ACCOUNTING
+	if (dbus_message_is_method_call(msg, BT_SYS_POPUP_INTERFACE,
+				BT_SYS_POPUP_METHOD_GET_MEMORY_STATS)) {
+		stats = __bluetooth_get_mem_stats(data);
+	} else
+#endif
+#ifdef BT_BENCHMARK
+	if (dbus_message_is_method_call(msg, BT_SYS_POPUP_INTERFACE,
+				BT_SYS_POPUP_METHOD_BENCH_REQUEST)) {
+		__bluetooth_bench_request(data, msg);
+	} else if (dbus_message_is_method_call(msg, BT_SYS_POPUP_INTERFACE,
+				BT_SYS_POPUP_METHOD_GET_MEMORY_SAMPLE)) {
+		stats = __bluetooth_bench_get_sample(data);
+	} else
+#endif
+	if (dbus_message_is_method_call(msg, BT_SYS_POPUP_INTERFACE,
+				BT_SYS_POPUP_METHOD_GET_STATS)) {
+		__bluetooth_open_recorder();
+		stats = __bluetooth_get_event_stats();
+	} else if (dbus_message_is_method_call(msg, BT_SYS_POPUP_INTERFACE,
+				BT_SYS_POPUP_METHOD_RESET_STATS)) {
+		__bluetooth_open_recorder();
+		bt_recorder_reset_stats();
+		bt_log_print(BT_POPUP, "Stats reset");
+	} else {
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
 
-		device_name = bundle_get_val(kb, "device-name");
-		file = bundle_get_val(kb, "file");
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL) {
+		g_free(stats);
+		return DBUS_HANDLER_RESULT_NEED_MEMORY;
+	}
 
-		if (device_name)
-			conv_str = elm_entry_utf8_to_markup(device_name);
+	if (stats)
+		dbus_message_append_args(reply, DBUS_TYPE_STRING, &stats,
+					 DBUS_TYPE_INVALID);
+	dbus_connection_send(conn, reply, NULL);
+	dbus_message_unref(reply);
+	g_free(stats);
 
-		snprintf(view_title, BT_TITLE_STR_MAX_LEN,
-			 BT_STR_RECEIVE_PS_FROM_PS_Q, file, conv_str);
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
 
-		if (conv_str)
-			free(conv_str);
+static const DBusObjectPathVTable bt_stats_vtable = {
+	.message_function = __bluetooth_stats_message_cb,
+};
 
-		__bluetooth_draw_popup(ad, view_title, BT_STR_YES, BT_STR_NO,
-				__bluetooth_push_authorization_request_cb);
-	} else if (!strcasecmp(event_type, "confirm-overwrite-request")) {
-		timeout = BT_AUTHORIZATION_TIMEOUT;
+/* Serve the statistics queries under BT_SYS_POPUP_IPC_NAME */
+static void __bluetooth_register_stats(struct bt_popup_appdata *ad)
+{
+	if (ad->stats_registered || __bluetooth_get_connection(ad) == NULL)
+		return;
 
-		file = bundle_get_val(kb, "file");
+	if (!dbus_connection_register_object_path(
+			dbus_g_connection_get_connection(ad->conn),
+			BT_SYS_POPUP_STATS_OBJECT, &bt_stats_vtable, ad)) {
+		bt_log_print(BT_POPUP, "Fail to register %s",
+			     BT_SYS_POPUP_STATS_OBJECT);
+		return;
+	}
 
-		snprintf(view_title, BT_TITLE_STR_MAX_LEN,
-			 BT_STR_OVERWRITE_FILE_Q, file);
+	ad->stats_registered = EINA_TRUE;
 
-		__bluetooth_draw_popup(ad, view_title, BT_STR_YES, BT_STR_NO,
-				__bluetooth_confirm_overwrite_request_cb);
-	} else if (!strcasecmp(event_type, "keyboard-passkey-request")) {
-		timeout = BT_AUTHENTICATION_TIMEOUT;
+	if (!ad->name_requested) {
+		ad->name_requested = TRUE;
+		__bluetooth_init_app_signal(ad);
+	}
+}
 
-		device_name = bundle_get_val(kb, "device-name");
-		passkey = bundle_get_val(kb, "passkey");
+/* AUL bundle handler */
+static int __bluetooth_launch_handler(struct bt_popup_appdata *ad,
+				      struct bt_popup_request *req)
+{
+	const struct bt_event_desc *desc;
+	double deadline;
 
-		if (device_name && passkey) {
-			conv_str = elm_entry_utf8_to_markup(device_name);
+	bt_log_print(BT_POPUP, "__bluetooth_launch_handler");
 
-			snprintf(view_title, BT_TITLE_STR_MAX_LEN,
-			     BT_STR_ENTER_PS_ON_PS_TO_PAIR, passkey, conv_str);
+	if (req == NULL || req->desc == NULL)
+		return -1;
 
-			bt_log_print(BT_POPUP, "title: %s", view_title);
+	__bluetooth_trace_mark(ad, BT_TRACE_LAUNCH_HANDLER);
 
-			if (conv_str)
-				free(conv_str);
+	desc = req->desc;
 
-			__bluetooth_draw_popup(ad, view_title,
-						BT_STR_CANCEL, NULL,
-						__bluetooth_input_cancel_cb);
-		} else {
-			timeout = BT_ERROR_TIMEOUT;
-		}
-	} else if (!strcasecmp(event_type, "bt-information")) {
-		bt_log_print(BT_POPUP, "bt-information");
-		timeout = BT_NOTIFICATION_TIMEOUT;
+	if ((req->data.keys & desc->required_keys) != desc->required_keys) {
+		bt_log_print(BT_POPUP, "%s: missing keys [0x%04x]", desc->name,
+			     desc->required_keys & ~req->data.keys);
+		return -1;
+	}
 
-		const char *title = NULL;
-		const char *type = NULL;
+	if (desc->render(ad, req) != 0)
+		return -1;
 
-		title = bundle_get_val(kb, "title");
-		type = bundle_get_val(kb, "type");
+	/* Nothing was drawn and nothing waits for an answer */
+	if (req->timeout == 0)
+		return 1;
 
-		if (title != NULL) {
-			if (strlen(title) > 255)
-				return -1;
-		} else
-			return -1;
+	if (!ad->frame_pending && ad->win_main) {
+		evas_event_callback_add(evas_object_evas_get(ad->win_main),
+					EVAS_CALLBACK_RENDER_POST,
+					__bluetooth_render_post_cb, ad);
+		ad->frame_pending = EINA_TRUE;
+	}
 
-		if (strcasecmp(type, "onebtn") == 0) {
-			__bluetooth_draw_popup(ad, title, BT_STR_OK, NULL,
-					     __bluetooth_app_confirm_cb);
-		} else if (strcasecmp(type, "none") == 0) {
-			__bluetooth_draw_popup(ad, title, NULL, NULL,
-					     __bluetooth_app_confirm_cb);
-		}
-	} else if (!strcasecmp(event_type, "exchange-request")) {
-		timeout = BT_AUTHORIZATION_TIMEOUT;
+	/* The renderer may shorten the timeout, the agent's deadline still
+	   applies, whichever comes first */
+	deadline = ecore_time_get() + req->timeout;
+	if (deadline < req->deadline)
+		req->deadline = deadline;
 
-		device_name = bundle_get_val(kb, "device-name");
+	__bluetooth_schedule_expiry(ad);
 
-		if (device_name)
-			conv_str = elm_entry_utf8_to_markup(device_name);
+	return 0;
+}
 
-		snprintf(view_title, BT_TITLE_STR_MAX_LEN,
-			 BT_STR_EXCHANGE_OBJECT_WITH_PS_Q, conv_str);
+/* Nothing left to show */
+static void __bluetooth_close(struct bt_popup_appdata *ad)
+{
+	/* Stay alive while an OBEX grant may answer the next requests */
+	if (ad && (ad->resident || ad->grant_timer)) {
+		__bluetooth_hide(ad);
+		return;
+	}
 
-		if (conv_str)
-			free(conv_str);
+	__bluetooth_exit(ad);
+}
 
-		__bluetooth_draw_popup(ad, view_title, BT_STR_YES, BT_STR_NO,
-				     __bluetooth_authorization_request_cb);
-	} else {
+static void __bluetooth_next_job_cb(void *data)
+{
+	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
 
-		return -1;
-	}
+	ad->next_job = NULL;
 
-	if (ad->event_type != BT_EVENT_FILE_RECIEVED)
-		ad->timer = ecore_timer_add(timeout, (Ecore_Task_Cb)
-					__bluetooth_request_timeout_cb,
-					ad);
+	/* A request arriving meanwhile was queued behind the others */
+	if (ad->request)
+		return;
 
-	return 0;
+	if (!__bluetooth_show_next_request(ad))
+		__bluetooth_close(ad);
 }
 
 static void __bluetooth_win_del(void *data)
 {
 	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
 
-	__bluetooth_cleanup(ad);
+	/* The request is answered, its timeout must not fire again */
+	if (ad && ad->timer) {
+		ecore_timer_del(ad->timer);
+		ad->timer = NULL;
+	}
 
-	elm_exit();
+	if (ad) {
+		if (ad->request) {
+			/* Each popup answers right before it is closed */
+			__bluetooth_trace_mark(ad, BT_TRACE_REPLY);
+			__bluetooth_trace_write(ad, ad->request);
+#ifdef BT_MEM_ACCOUNTING
+			__bluetooth_mem_account(ad, TRUE);
+#endif
+			__bluetooth_check_growth(ad, ad->request);
+		}
+
+		__bluetooth_request_free(ad->request);
+		ad->request = NULL;
+
+		/* Called from the clicked button or a signal handler. Drawing
+		   the next request here would rebind the callbacks of the
+		   button Evas is still walking. */
+		if (ad->queue_len > 0) {
+			__bluetooth_hide_popup(ad);
+			if (ad->next_job == NULL)
+				ad->next_job = ecore_job_add(
+						__bluetooth_next_job_cb, ad);
+			return;
+		}
+	}
+
+	__bluetooth_close(ad);
 }
 
-static Evas_Object *__bluetooth_create_win(const char *name)
+/* A compact window is sized to each popup, see __bluetooth_fit_win */
+static Evas_Object *__bluetooth_create_win(const char *name,
+					   Eina_Bool compact)
 {
 	Evas_Object *eo;
 	int w;
@@ -1013,49 +3130,19 @@ static Evas_Object *__bluetooth_create_win(const char *name)
 	if (eo) {
 		elm_win_title_set(eo, name);
 		elm_win_borderless_set(eo, EINA_TRUE);
-		ecore_x_window_size_get(ecore_x_window_root_first_get(),
+		if (!compact) {
+			ecore_x_window_size_get(
+					ecore_x_window_root_first_get(),
 					&w, &h);
-		evas_object_resize(eo, w, h);
+			evas_object_resize(eo, w, h);
+			bt_log_print(BT_POPUP, "Window %dx%d, ARGB buffer %d KB",
+				     w, h, w * h * 4 / 1024);
+		}
 	}
 
 	return eo;
 }
 
-static void __bluetooth_session_init(struct bt_popup_appdata *ad)
-{
-	DBusGConnection *conn = NULL;
-	GError *err = NULL;
-
-	g_type_init();
-
-	conn = dbus_g_bus_get(DBUS_BUS_SYSTEM, &err);
-
-	if (!conn) {
-		bt_log_print(BT_POPUP,
-			     "ERROR: Can't get on system bus [%s]",
-			     err->message);
-		g_error_free(err);
-		return;
-	}
-
-	ad->agent_proxy = dbus_g_proxy_new_for_name(conn,
-						    "org.bluez.frwk_agent",
-						    "/org/bluez/agent/frwk_agent",
-						    "org.bluez.Agent");
-	if (!ad->agent_proxy)
-		bt_log_print(BT_POPUP, "Could not create a agent dbus proxy");
-
-	ad->obex_proxy = dbus_g_proxy_new_for_name(conn,
-						   "org.bluez.frwk_agent",
-						   "/org/obex/ops_agent",
-						   "org.openobex.Agent");
-	if (!ad->obex_proxy)
-		bt_log_print(BT_POPUP, "Could not create obex dbus proxy");
-
-	if (!__bluetooth_init_app_signal(ad))
-		bt_log_print(BT_POPUP, "__bt_syspopup_init_app_signal failed");
-}
-
 static int __bluetooth_create(void *data)
 {
 	struct bt_popup_appdata *ad = data;
@@ -1063,8 +3150,10 @@ static int __bluetooth_create(void *data)
 
 	bt_log_print(BT_POPUP, "__bluetooth_create() start.\n");
 
+	__bluetooth_trace_mark(ad, BT_TRACE_CREATE_START);
+
 	/* create window */
-	win = __bluetooth_create_win(PACKAGE);
+	win = __bluetooth_create_win(PACKAGE, ad->compact);
 	if (win == NULL)
 		return -1;
 	ad->win_main = win;
@@ -1073,13 +3162,23 @@ static int __bluetooth_create(void *data)
 	if (appcore_set_i18n(BT_COMMON_PKG, BT_COMMON_RES) < 0)
 		return -1;
 
-	ecore_imf_init();
+	/* Our own strings, see po/ */
+	bindtextdomain(PACKAGE, LOCALEDIR);
+
+	__bluetooth_trace_mark(ad, BT_TRACE_I18N);
+
+	__bluetooth_load_strings();
+	appcore_set_event_callback(APPCORE_EVENT_LANG_CHANGE,
+				   __bluetooth_lang_changed_cb, ad);
+
+	g_type_init();
+
 	ad->event_handle = ecore_event_handler_add(ECORE_EVENT_KEY_DOWN,
 						   (Ecore_Event_Handler_Cb)
 						   __bluetooth_keydown_cb,
 						   ad);
 
-	__bluetooth_session_init(ad);
+	__bluetooth_trace_mark(ad, BT_TRACE_CREATE_END);
 
 	return 0;
 }
@@ -1091,6 +3190,42 @@ static int __bluetooth_terminate(void *data)
 	if (ad->event_handle)
 		ecore_event_handler_del(ad->event_handle);
 
+	if (ad->idle_timer)
+		ecore_timer_del(ad->idle_timer);
+
+	ad->idle_timer = NULL;
+
+	if (ad->grant_timer)
+		ecore_timer_del(ad->grant_timer);
+
+	ad->grant_timer = NULL;
+
+	if (ad->prepare_idler)
+		ecore_idler_del(ad->prepare_idler);
+
+	ad->prepare_idler = NULL;
+
+	if (ad->prewarm_idler)
+		ecore_idler_del(ad->prewarm_idler);
+
+	ad->prewarm_idler = NULL;
+
+	if (ad->submit_job)
+		ecore_job_del(ad->submit_job);
+
+	ad->submit_job = NULL;
+
+	if (ad->next_job)
+		ecore_job_del(ad->next_job);
+
+	ad->next_job = NULL;
+
+	__bluetooth_cancel_queued_requests(ad);
+	__bluetooth_request_outcome(ad->request, BT_RECORD_TERMINATED,
+				    BT_RECORD_RESPONSE_NONE);
+	__bluetooth_request_free(ad->request);
+	ad->request = NULL;
+
 	if (ad->popup)
 		evas_object_del(ad->popup);
 
@@ -1099,6 +3234,23 @@ static int __bluetooth_terminate(void *data)
 
 	ad->popup = NULL;
 	ad->win_main = NULL;
+	ad->imf_context = NULL;
+
+	if (ad->imf_initialized)
+		ecore_imf_shutdown();
+
+	ad->imf_initialized = EINA_FALSE;
+
+	bt_policy_free(ad->policy);
+	ad->policy = NULL;
+
+#ifdef BT_PROVISIONING
+	bt_provision_free(ad->provision);
+	ad->provision = NULL;
+#endif
+
+	__bluetooth_free_strings();
+	bt_recorder_close();
 
 	return 0;
 }
@@ -1115,11 +3267,239 @@ static int __bluetooth_resume(void *data)
 	return 0;
 }
 
+static void __bluetooth_prepare_reply(struct bt_popup_appdata *ad,
+				    const struct bt_reply_desc *reply)
+{
+	switch (reply->kind) {
+	case BT_REPLY_KIND_METHOD:
+		__bluetooth_get_proxy(ad, reply->proxy);
+		break;
+
+	case BT_REPLY_KIND_SIGNAL:
+		if (__bluetooth_get_connection(ad) && !ad->name_requested) {
+			ad->name_requested = TRUE;
+			__bluetooth_init_app_signal(ad);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+/* Create what the shown request replies with, once the popup is drawn */
+static void __bluetooth_prepare_resources(struct bt_popup_appdata *ad,
+					  const struct bt_event_desc *desc)
+{
+	if (desc == NULL)
+		return;
+
+	__bluetooth_prepare_reply(ad, &desc->accept);
+	__bluetooth_prepare_reply(ad, &desc->cancel);
+
+	__bluetooth_register_stats(ad);
+}
+
+/* Most used layouts first */
+static const bt_popup_layout_t bt_prewarm_order[] = {
+	BT_POPUP_LAYOUT_TWO_BTN,
+	BT_POPUP_LAYOUT_ONE_BTN,
+	BT_POPUP_LAYOUT_THREE_BTN,
+	BT_POPUP_LAYOUT_NONE,
+	BT_POPUP_LAYOUT_INPUT,
+};
+
+/* Build one missing template per idle run, so the next popup of that
+   layout reuses it instead of building it on its way to the first frame.
+   Glyphs are only rasterized when drawn. The first frame log of
+   __bluetooth_trace_write tells what a prewarmed template saves. */
+static int __bluetooth_prewarm_idler_cb(void *data)
+{
+	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
+	struct bt_popup_template *tpl = NULL;
+	bt_popup_layout_t layout;
+	gint64 start;
+	int i;
+
+	if (ad->win_main == NULL) {
+		ad->prewarm_idler = NULL;
+		return 0;
+	}
+
+	for (i = 0; i < G_N_ELEMENTS(bt_prewarm_order); i++) {
+		layout = bt_prewarm_order[i];
+		if (ad->templates[layout].popup == NULL) {
+			tpl = &ad->templates[layout];
+			break;
+		}
+	}
+
+	if (tpl == NULL) {
+		ad->prewarm_idler = NULL;
+		return 0;
+	}
+
+	start = g_get_monotonic_time();
+
+	if (layout == BT_POPUP_LAYOUT_INPUT) {
+		if (__bluetooth_create_input_view(ad, tpl) < 0) {
+			ad->prewarm_idler = NULL;
+			return 0;
+		}
+		elm_object_text_set(tpl->check, BT_STR_SHOW_PASSWORD);
+		elm_object_text_set(tpl->btn1, BT_STR_OK);
+		elm_object_text_set(tpl->btn2, BT_STR_CANCEL);
+	} else {
+		__bluetooth_get_popup_template(ad, layout);
+		if (tpl->btn1)
+			elm_object_text_set(tpl->btn1, BT_STR_YES);
+		if (tpl->btn2)
+			elm_object_text_set(tpl->btn2, BT_STR_NO);
+		if (tpl->btn3)
+			elm_object_text_set(tpl->btn3, BT_STR_ACCEPT_ALL);
+	}
+
+	evas_smart_objects_calculate(evas_object_evas_get(ad->win_main));
+	tpl->prewarmed = EINA_TRUE;
+
+	bt_log_print(BT_POPUP, "Layout %d built in %lld us", layout,
+		     (long long)(g_get_monotonic_time() - start));
+
+	return 1;
+}
+
+static int __bluetooth_prepare_idler_cb(void *data)
+{
+	struct bt_popup_appdata *ad = (struct bt_popup_appdata *)data;
+
+	ad->prepare_idler = NULL;
+
+	if (ad->request)
+		__bluetooth_prepare_resources(ad, ad->request->desc);
+
+	/* Only worth it when another popup will follow in this process */
+	if ((ad->resident || ad->queue_len > 0) && ad->prewarm_idler == NULL)
+		ad->prewarm_idler = ecore_idler_add((Ecore_Task_Cb)
+					__bluetooth_prewarm_idler_cb, ad);
+
+	return 0;
+}
+
+static int __bluetooth_show_request(struct bt_popup_appdata *ad,
+				   struct bt_popup_request *req)
+{
+	struct bt_event_stats *stats;
+	int ret = 0;
+
+	ad->request = req;
+	ad->event_type = req->event_type;
+
+	/* A compact window has nothing to blend around the popup */
+	elm_win_alpha_set(ad->win_main, !ad->compact);
+
+	/* The syspopup is already registered for a reused window */
+	if (ad->syspopup_created)
+		ret = syspopup_reset(req->b);
+	else
+		ret = syspopup_create(req->b, &handler, ad->win_main, ad);
+
+	if (ret == -1) {
+		bt_log_print(BT_POPUP, "syspopup_create err");
+		__bluetooth_open_recorder();
+		stats = bt_recorder_stats(req->event_type);
+		if (stats)
+			stats->create_failed++;
+		__bluetooth_remove_all_event(ad);
+		return -1;
+	}
+
+	ad->syspopup_created = EINA_TRUE;
+	__bluetooth_trace_mark(ad, BT_TRACE_SYSPOPUP_CREATE);
+
+	ret = __bluetooth_launch_handler(ad, req);
+
+	if (ret > 0) {
+		__bluetooth_win_del(ad);
+		return 0;
+	} else if (ret < 0) {
+		__bluetooth_remove_all_event(ad);
+	} else if (ad->prepare_idler == NULL) {
+		ad->prepare_idler = ecore_idler_add((Ecore_Task_Cb)
+					__bluetooth_prepare_idler_cb, ad);
+	}
+
+	/* Change LCD brightness */
+	ret = pm_change_state(LCD_NORMAL);
+	if (ret != 0)
+		bt_log_print(BT_POPUP, "Fail to change LCD");
+
+	return 0;
+}
+
+/* Show the most urgent queued request. Requests whose deadline passed
+   while waiting are cancelled without being drawn. */
+static gboolean __bluetooth_show_next_request(struct bt_popup_appdata *ad)
+{
+	struct bt_popup_request *req;
+
+	__bluetooth_expire_queued_requests(ad);
+
+	while ((req = __bluetooth_request_dequeue(ad)) != NULL) {
+		if (!__bluetooth_check_obex_grant(ad, req))
+			break;
+
+		__bluetooth_request_free(req);
+	}
+
+	if (req == NULL)
+		return FALSE;
+
+	__bluetooth_hide_popup(ad);
+	__bluetooth_show_request(ad, req);
+
+	return TRUE;
+}
+
+/* A message without buttons has nothing to answer, the notification
+   ticker shows it without a dialog, an LCD wake or agent proxies */
+static gboolean __bluetooth_is_ticker(struct bt_popup_request *req)
+{
+	if (!req->desc->ticker || req->data.title == NULL ||
+	    req->data.type == NULL)
+		return FALSE;
+
+	return strcasecmp(req->data.type, "none") == 0;
+}
+
+static void __bluetooth_post_ticker(struct bt_popup_appdata *ad,
+				    struct bt_popup_request *req,
+				    gint64 start)
+{
+	int ret;
+
+	__bluetooth_request_outcome(req, BT_RECORD_TICKER,
+				    BT_RECORD_RESPONSE_CANCEL);
+
+	ret = notification_status_message_post(req->data.title);
+	if (ret != NOTIFICATION_ERROR_NONE)
+		bt_log_print(BT_POPUP, "Fail to post ticker [%d]", ret);
+
+	/* Same answer as the dialog gave when its timeout expired */
+	__bluetooth_send_reply(ad, req->desc, BT_AGENT_CANCEL);
+
+	bt_log_print(BT_POPUP, "%s ticker in %lld us, RSS %ld KB",
+		     req->desc->name,
+		     (long long)(g_get_monotonic_time() - start),
+		     __bluetooth_get_rss_kb());
+}
+
 static int __bluetooth_reset(bundle *b, void *data)
 {
 	struct bt_popup_appdata *ad = data;
+	struct bt_popup_request *req = NULL;
+	const struct bt_event_desc *desc;
 	const char *event_type = NULL;
-	int ret = 0;
+	gint64 start = g_get_monotonic_time();
 
 	bt_log_print(BT_POPUP, "__bluetooth_reset()\n");
 
@@ -1128,44 +3508,122 @@ static int __bluetooth_reset(bundle *b, void *data)
 		return -1;
 	}
 
+#ifdef BT_BENCHMARK
+	/* Soak run: stay alive for the requests sent over D-Bus */
+	if (bundle_get_val(b, BT_BENCH_SOAK_KEY))
+		ad->resident = EINA_TRUE;
+#endif
+
 	/* Start Main UI */
 	event_type = bundle_get_val(b, "event-type");
 
 	if (event_type != NULL) {
 		if (!strcasecmp(event_type, "terminate")) {
+			__bluetooth_cancel_queued_requests(ad);
+			__bluetooth_request_outcome(ad->request,
+						    BT_RECORD_TERMINATED,
+						    BT_RECORD_RESPONSE_NONE);
 			__bluetooth_win_del(ad);
 			return 0;
 		}
 
-		if (syspopup_has_popup(b)) {
-			/* Destroy the existing popup*/
-			__bluetooth_cleanup(ad);
-			/* create window */
-			ad->win_main = __bluetooth_create_win(PACKAGE);
-			if (ad->win_main == NULL)
-				return -1;
+		desc = __bluetooth_find_event_desc(event_type);
+		if (desc == NULL) {
+			bt_log_print(BT_POPUP, "Unknown event [%s]", event_type);
+			if (ad->request == NULL)
+				__bluetooth_win_del(ad);
+			return 0;
 		}
 
-		__bluetooth_parse_event(ad, event_type);
+		req = __bluetooth_request_new(b, desc);
+		if (req == NULL)
+			return -1;
 
-		elm_win_alpha_set(ad->win_main, EINA_TRUE);
+		req->trace[BT_TRACE_RESET] = start;
 
-		ret = syspopup_create(b, &handler, ad->win_main, ad);
-		if (ret == -1) {
-			bt_log_print(BT_POPUP, "syspopup_create err");
-			__bluetooth_remove_all_event(ad);
-		} else {
-			ret = __bluetooth_launch_handler(ad,
-						       b, event_type);
+		if (__bluetooth_check_obex_grant(ad, req)) {
+			__bluetooth_request_free(req);
+			return 0;
+		}
+
+		if (__bluetooth_check_policy(ad, req)) {
+			__bluetooth_request_free(req);
+			if (ad->request == NULL)
+				__bluetooth_win_del(ad);
+			return 0;
+		}
+
+#ifdef BT_PROVISIONING
+		if (__bluetooth_check_provision(ad, req)) {
+			__bluetooth_request_free(req);
+			if (ad->request == NULL)
+				__bluetooth_win_del(ad);
+			return 0;
+		}
+#endif
+
+		/* The agent gave up while the popup was launched */
+		if (req->timeout > 0 && req->deadline <= ecore_time_get()) {
+			bt_log_print(BT_POPUP, "Request [0x%04x] already expired",
+				     req->event_type);
+			__bluetooth_request_outcome(req, BT_RECORD_EXPIRED,
+						    BT_RECORD_RESPONSE_CANCEL);
+			__bluetooth_send_reply(ad, req->desc, BT_AGENT_CANCEL);
+			__bluetooth_request_free(req);
+			if (ad->request == NULL)
+				__bluetooth_win_del(ad);
+			return 0;
+		}
+
+		if (__bluetooth_is_ticker(req)) {
+			__bluetooth_post_ticker(ad, req, start);
+			__bluetooth_request_free(req);
+			if (ad->request == NULL)
+				__bluetooth_win_del(ad);
+			return 0;
+		}
+
+		if (ad->request || ad->next_job) {
+			/* Another popup is shown or about to be, wait for the
+			   turn of this one */
+			if (__bluetooth_request_enqueue(ad, req) < 0) {
+				bt_log_print(BT_POPUP, "Request queue is full");
+				__bluetooth_request_outcome(req,
+						BT_RECORD_QUEUE_FULL,
+						BT_RECORD_RESPONSE_REJECT);
+				__bluetooth_send_reply(ad, req->desc,
+						       BT_AGENT_REJECT);
+				__bluetooth_request_free(req);
+			} else {
+				__bluetooth_schedule_expiry(ad);
+			}
+			return 0;
+		}
 
-			if (ret != 0)
-				__bluetooth_remove_all_event(ad);
+		if (syspopup_has_popup(b)) {
+			if ((ad->resident || ad->grant_timer) && ad->win_main) {
+				/* Keep the window, drop the existing popup */
+				__bluetooth_hide(ad);
+			} else {
+				/* Destroy the existing popup*/
+				__bluetooth_cleanup(ad);
+				ad->syspopup_created = EINA_FALSE;
+				/* create window */
+				ad->win_main = __bluetooth_create_win(PACKAGE,
+								ad->compact);
+				if (ad->win_main == NULL) {
+					__bluetooth_request_free(req);
+					return -1;
+				}
+			}
+		}
 
-			/* Change LCD brightness */
-			ret = pm_change_state(LCD_NORMAL);
-			if (ret != 0)
-				bt_log_print(BT_POPUP, "Fail to change LCD");
+		if (ad->idle_timer) {
+			ecore_timer_del(ad->idle_timer);
+			ad->idle_timer = NULL;
 		}
+
+		__bluetooth_show_request(ad, req);
 	} else {
 		bt_log_print(BT_POPUP, "event type is NULL \n");
 	}
@@ -1173,7 +3631,7 @@ static int __bluetooth_reset(bundle *b, void *data)
 	return 0;
 }
 
-int main(int argc, char *argv[])
+EXPORT_API int main(int argc, char *argv[])
 {
 	struct bt_popup_appdata ad;
 	struct appcore_ops ops = {
@@ -1187,6 +3645,16 @@ int main(int argc, char *argv[])
 	memset(&ad, 0x0, sizeof(struct bt_popup_appdata));
 	ops.data = &ad;
 
+	ad.launch_trace[BT_TRACE_MAIN] = g_get_monotonic_time();
+
+#ifdef BT_RESIDENT_MODE
+	ad.resident = EINA_TRUE;
+#endif
+
+#ifdef BT_COMPACT_WINDOW
+	ad.compact = EINA_TRUE;
+#endif
+
 	return appcore_efl_main(PACKAGE, &argc, &argv, &ops);
 }
 
@@ -18,10 +18,13 @@
 #define __DEF_BT_SYSPOPUP_H_
 
 #include <Elementary.h>
+#include <bundle.h>
 #include <dlog.h>
 #include <glib.h>
 #include <dbus/dbus-glib.h>
 
+#include "bt-recorder.h"
+
 #ifndef PACKAGE_NAME
 #define PACKAGE_NAME "org.tizen.bt-syspopup"
 #endif
@@ -30,11 +33,16 @@
 #define PREFIX "/opt/apps"PACKAGE_NAME
 #endif
 
+#ifndef EXPORT_API
+#define EXPORT_API
+#endif
+
 #define TEMP_DIR	"/tmp"
 
 #define PACKAGE		"bt-syspopup"
 #define APPNAME		"bt-syspopup"
 #define ICON_DIR	PREFIX"/res/default/small/icon"
+#define LOCALEDIR	PREFIX"/res/locale"
 
 #define BT_COMMON_PKG		"ug-setting-bluetooth-efl"
 #define BT_COMMON_RES		"/opt/ug/res/locale"
@@ -45,6 +53,32 @@
 #define BT_AUTHORIZATION_TIMEOUT		15
 #define BT_NOTIFICATION_TIMEOUT		2
 #define BT_ERROR_TIMEOUT			1
+#define BT_RESIDENT_IDLE_TIMEOUT		300
+#define BT_OBEX_GRANT_TIMEOUT		60
+#define BT_REPLY_FLUSH_TIMEOUT		50	/* msec, before exit */
+
+#define BT_TRACE_FILE	TEMP_DIR"/bt-syspopup-trace.log"
+
+/* Auto-response rules, see bt-policy.h */
+#ifndef BT_POLICY_FILE
+#define BT_POLICY_FILE	"/opt/etc/bt-syspopup-policy.conf"
+#endif
+
+/* Provisioned PIN codes and passkeys, see bt-provision.h */
+#ifndef BT_PROVISION_FILE
+#define BT_PROVISION_FILE	"/opt/etc/bt-syspopup-provision.conf"
+#endif
+
+/* Typed by the benchmark build, a valid PIN code and passkey */
+#ifdef BT_BENCHMARK
+#define BT_BENCH_CODE	"123456"
+/* Launch key of a soak run, the popup stays for the next requests */
+#define BT_BENCH_SOAK_KEY	"bench-soak"
+#endif
+
+#define BT_EVENT_DESC_MAX 16	/* Entries of the event descriptor table */
+#define BT_REQUEST_QUEUE_MAX 8	/* Requests waiting behind the shown one */
+#define BT_OBEX_GRANT_MAX 4	/* Devices with an "accept all" grant */
 
 #define BT_PIN_MLEN 16		/* Pin key max length */
 #define BT_PK_MLEN 6		/* Passkey max length */
@@ -65,50 +99,87 @@
 #define bt_log_print(tag, format, args...) LOG(LOG_DEBUG, \
 	tag, "%s:%d "format, __func__, __LINE__, ##args)
 
+/* Agent which launches the popup and receives the replies. The service
+   name can be overridden to talk to a stand-in agent. */
+#ifndef BT_AGENT_SERVICE
+#define BT_AGENT_SERVICE "org.bluez.frwk_agent"
+#endif
+#define BT_AGENT_PATH "/org/bluez/agent/frwk_agent"
+#define BT_AGENT_INTERFACE "org.bluez.Agent"
+#define BT_OBEX_AGENT_PATH "/org/obex/ops_agent"
+#define BT_OBEX_AGENT_INTERFACE "org.openobex.Agent"
+
+#define BT_AGENT_SIGNAL_CANCEL "Cancel"	/* Shown request is void */
+#define BT_AGENT_SIGNAL_RELEASE "Release"	/* All requests are void */
+
 #define BT_SYS_POPUP_IPC_NAME "org.projectx"
 #define BT_SYS_POPUP_IPC_RESPONSE_OBJECT "/org/projectx/bt_syspopup_res"
 #define BT_SYS_POPUP_INTERFACE "User.Bluetooth.syspopup"
 #define BT_SYS_POPUP_METHOD_RESPONSE "Response"
-
-/* String defines to support multi-languages */
-#define BT_STR_ENTER_PIN	\
-	dgettext(BT_COMMON_PKG, "IDS_BT_HEADER_ENTERPIN")
-#define BT_STR_ALLOW_PS_TO_CONNECT_Q	\
-	dgettext(BT_COMMON_PKG, "IDS_BT_POP_ALLOW_PS_TO_CONNECT_Q")
-
-#define BT_STR_RECEIVE_PS_FROM_PS_Q \
-	dgettext(BT_COMMON_PKG, "IDS_BT_POP_RECEIVE_PS_FROM_PS_Q")
-
-#define BT_STR_PASSKEY_MATCH_Q \
-	dgettext(BT_COMMON_PKG, "IDS_BT_POP_MATCH_PASSKEYS_ON_PS_Q")
-
-#define BT_STR_OVERWRITE_FILE_Q \
-	dgettext(BT_COMMON_PKG, "IDS_BT_POP_PS_ALREADY_EXISTS_OVERWRITE_Q")
-
-#define BT_STR_ENTER_PS_ON_PS_TO_PAIR \
-	dgettext(BT_COMMON_PKG, "IDS_BT_BODY_ENTER_P1SS_ON_P2SS_TO_PAIR_THEN_TAP_RETURN_OR_ENTER")
-
+#define BT_SYS_POPUP_STATS_OBJECT "/org/projectx/bt_syspopup_stats"
+#define BT_SYS_POPUP_METHOD_GET_MEMORY_STATS "GetMemoryStats"
+#define BT_SYS_POPUP_METHOD_GET_STATS "GetStats"
+#define BT_SYS_POPUP_METHOD_RESET_STATS "ResetStats"
+/* Benchmark build only, see bench/bt-bench.c */
+#define BT_SYS_POPUP_METHOD_BENCH_REQUEST "BenchRequest"
+#define BT_SYS_POPUP_METHOD_GET_MEMORY_SAMPLE "GetMemorySample"
+
+/* String defines to support multi-languages. The catalog is read once
+   into bt_str[] and again on a language change, see
+   __bluetooth_load_strings() */
+typedef enum {
+	BT_STR_ID_ENTER_PIN,
+	BT_STR_ID_ALLOW_PS_TO_CONNECT_Q,
+	BT_STR_ID_RECEIVE_PS_FROM_PS_Q,
+	BT_STR_ID_PASSKEY_MATCH_Q,
+	BT_STR_ID_OVERWRITE_FILE_Q,
+	BT_STR_ID_ENTER_PS_ON_PS_TO_PAIR,
+	BT_STR_ID_EXCHANGE_OBJECT_WITH_PS_Q,
+	BT_STR_ID_BLUETOOTH_PAIRING_REQUEST,
+	BT_STR_ID_ENTER_PIN_TO_PAIR,
+	BT_STR_ID_SHOW_PASSWORD,
+	BT_STR_ID_CONFIRM_PASSKEY_PS_TO_PAIR_WITH_PS,
+	BT_STR_ID_ACCEPT_ALL,
+	BT_STR_ID_APPLY_TO_ALL,
+	BT_STR_ID_OK,
+	BT_STR_ID_YES,
+	BT_STR_ID_NO,
+	BT_STR_ID_DONE,
+	BT_STR_ID_CANCEL,
+	BT_STR_ID_MAX,
+} bt_str_id_t;
+
+#define BT_STR_ENTER_PIN			bt_str[BT_STR_ID_ENTER_PIN]
+#define BT_STR_ALLOW_PS_TO_CONNECT_Q		bt_str[BT_STR_ID_ALLOW_PS_TO_CONNECT_Q]
+#define BT_STR_RECEIVE_PS_FROM_PS_Q		bt_str[BT_STR_ID_RECEIVE_PS_FROM_PS_Q]
+#define BT_STR_PASSKEY_MATCH_Q			bt_str[BT_STR_ID_PASSKEY_MATCH_Q]
+#define BT_STR_OVERWRITE_FILE_Q			bt_str[BT_STR_ID_OVERWRITE_FILE_Q]
+#define BT_STR_ENTER_PS_ON_PS_TO_PAIR		bt_str[BT_STR_ID_ENTER_PS_ON_PS_TO_PAIR]
 #define BT_STR_EXCHANGE_OBJECT_WITH_PS_Q \
-	dgettext(BT_COMMON_PKG, "IDS_BT_POP_EXCHANGEOBJECT")
-
-/* Need to convert the design ID */
+	bt_str[BT_STR_ID_EXCHANGE_OBJECT_WITH_PS_Q]
 #define BT_STR_BLUETOOTH_PAIRING_REQUEST \
-	dgettext(BT_COMMON_PKG, "IDS_BT_HEADER_BLUETOOTH_PAIRING_REQUEST")
-
-#define BT_STR_ENTER_PIN_TO_PAIR \
-	dgettext(BT_COMMON_PKG, "IDS_BT_POP_ENTER_PIN_TO_PAIR_WITH_PS_HTRY_0000_OR_1234")
-
-#define BT_STR_SHOW_PASSWORD \
-	dgettext(BT_COMMON_PKG, "IDS_BT_BODY_SHOW_PASSWORD")
-
+	bt_str[BT_STR_ID_BLUETOOTH_PAIRING_REQUEST]
+#define BT_STR_ENTER_PIN_TO_PAIR		bt_str[BT_STR_ID_ENTER_PIN_TO_PAIR]
+#define BT_STR_SHOW_PASSWORD			bt_str[BT_STR_ID_SHOW_PASSWORD]
 #define BT_STR_CONFIRM_PASSKEY_PS_TO_PAIR_WITH_PS \
-	dgettext(BT_COMMON_PKG, "IDS_BT_POP_CONFIRM_PASSKEY_IS_P2SS_TO_PAIR_WITH_P1SS")
+	bt_str[BT_STR_ID_CONFIRM_PASSKEY_PS_TO_PAIR_WITH_PS]
+#define BT_STR_ACCEPT_ALL			bt_str[BT_STR_ID_ACCEPT_ALL]
+#define BT_STR_APPLY_TO_ALL			bt_str[BT_STR_ID_APPLY_TO_ALL]
+#define BT_STR_OK				bt_str[BT_STR_ID_OK]
+#define BT_STR_YES				bt_str[BT_STR_ID_YES]
+#define BT_STR_NO				bt_str[BT_STR_ID_NO]
+#define BT_STR_DONE				bt_str[BT_STR_ID_DONE]
+#define BT_STR_CANCEL				bt_str[BT_STR_ID_CANCEL]
+
+/* Response of a popup button, set as its BT_BTN_RESPONSE_KEY data */
+typedef enum {
+	BT_BTN_ACCEPT,		/* button1: OK / Yes */
+	BT_BTN_REJECT,		/* button2: Cancel / No */
+	BT_BTN_ACCEPT_ALL,	/* button3: Accept all / Apply to all */
+	BT_BTN_CANCEL,		/* button1 of a Cancel only popup */
+} bt_btn_response_t;
 
-#define BT_STR_OK dgettext("sys_string", "IDS_COM_SK_OK")
-#define BT_STR_YES dgettext("sys_string", "IDS_COM_SK_YES")
-#define BT_STR_NO dgettext("sys_string", "IDS_COM_SK_NO")
-#define BT_STR_DONE dgettext("sys_string", "IDS_COM_SK_DONE")
-#define BT_STR_CANCEL dgettext("sys_string", "IDS_COM_SK_CANCEL")
+#define BT_BTN_RESPONSE_KEY "bt_response"
 
 typedef enum {
 	BT_CHANGED_MODE_ENABLE,
@@ -138,6 +209,193 @@ typedef enum {
 	BT_CORE_AGENT_TIMEOUT,
 } bt_agent_accept_type_t;
 
+typedef enum {
+	BT_PROXY_AGENT,		/* org.bluez.Agent of frwk_agent */
+	BT_PROXY_OBEX,		/* org.openobex.Agent of frwk_agent */
+} bt_proxy_type_t;
+
+typedef enum {
+	BT_REPLY_PIN_CODE,
+	BT_REPLY_PASSKEY,
+	BT_REPLY_CONFIRMATION,
+	BT_REPLY_AUTHORIZE,
+	BT_REPLY_OVERWRITE,
+	BT_REPLY_METHOD_MAX,
+} bt_reply_method_t;
+
+/* Send-to-ack latency of the agent replies, per reply method */
+struct bt_reply_stats {
+	unsigned int sent;
+	unsigned int acked;
+	unsigned int failed;
+	gint64 total_us;
+	gint64 max_us;
+};
+
+typedef enum {
+	BT_REQUEST_PRIORITY_AUTHENTICATION,
+	BT_REQUEST_PRIORITY_AUTHORIZATION,
+	BT_REQUEST_PRIORITY_INFORMATION,
+} bt_request_priority_t;
+
+typedef enum {
+	BT_REPLY_KIND_NONE,
+	BT_REPLY_KIND_METHOD,	/* Reply method on an agent proxy */
+	BT_REPLY_KIND_SIGNAL,	/* User.Bluetooth.syspopup Response signal */
+} bt_reply_kind_t;
+
+struct bt_reply_desc {
+	bt_reply_kind_t kind;
+	bt_proxy_type_t proxy;
+	bt_reply_method_t method;
+};
+
+/* Bundle keys a request may carry */
+typedef enum {
+	BT_BUNDLE_KEY_DEVICE_NAME = 0x0001,
+	BT_BUNDLE_KEY_DEVICE_ADDRESS = 0x0002,
+	BT_BUNDLE_KEY_PASSKEY = 0x0004,
+	BT_BUNDLE_KEY_FILE = 0x0008,
+	BT_BUNDLE_KEY_TITLE = 0x0010,
+	BT_BUNDLE_KEY_TYPE = 0x0020,
+	BT_BUNDLE_KEY_DEADLINE = 0x0040,
+	BT_BUNDLE_KEY_SERVICE = 0x0080,
+} bt_bundle_key_t;
+
+/* Bundle values of a request, decoded in one pass. The strings belong
+   to the request bundle. */
+struct bt_popup_request_data {
+	unsigned int keys;	/* bt_bundle_key_t present in the bundle */
+	const char *device_name;
+	const char *device_address;
+	const char *passkey;
+	const char *file;
+	const char *title;
+	const char *type;
+	const char *deadline;	/* CLOCK_MONOTONIC msec, set by the agent */
+	const char *service;	/* UUID of the authorized service */
+};
+
+struct bt_popup_appdata;
+struct bt_popup_request;
+struct bt_policy;
+struct bt_provision_store;
+
+/* Everything the popup knows about one event type */
+struct bt_event_desc {
+	const char *name;		/* "event-type" bundle value */
+	bt_popup_event_type_t event_type;
+	bt_request_priority_t priority;
+	unsigned int required_keys;	/* bt_bundle_key_t */
+	int timeout;
+	int (*render) (struct bt_popup_appdata *ad,
+		       struct bt_popup_request *req);
+	Eina_Bool ticker;		/* type "none" goes to the ticker */
+	Eina_Bool policy;		/* May be answered by the policy file */
+	struct bt_reply_desc accept;
+	struct bt_reply_desc cancel;
+};
+
+/* Launch phases, stamped with g_get_monotonic_time(). The phases before
+   BT_TRACE_RESET happen once per process. */
+typedef enum {
+	BT_TRACE_MAIN,			/* appcore_efl_main entry */
+	BT_TRACE_CREATE_START,
+	BT_TRACE_I18N,			/* appcore_set_i18n done */
+	BT_TRACE_CREATE_END,
+	BT_TRACE_SESSION_INIT,		/* System bus connection */
+	BT_TRACE_RESET,
+	BT_TRACE_SYSPOPUP_CREATE,
+	BT_TRACE_LAUNCH_HANDLER,
+	BT_TRACE_POPUP_SHOW,		/* evas_object_show of the popup */
+	BT_TRACE_FIRST_FRAME,
+	BT_TRACE_USER_RESPONSE,		/* Button click */
+	BT_TRACE_REPLY,
+	BT_TRACE_PHASE_MAX,
+} bt_trace_phase_t;
+
+/* Where the template of a drawn popup came from */
+typedef enum {
+	BT_TEMPLATE_BUILT,		/* On the way to the first frame */
+	BT_TEMPLATE_PREWARMED,		/* By the prewarm idler, first use */
+	BT_TEMPLATE_REUSED,		/* Drawn before */
+} bt_template_origin_t;
+
+/* Context of one bundle received by __bluetooth_reset */
+struct bt_popup_request {
+	bundle *b;
+	const struct bt_event_desc *desc;
+	struct bt_popup_request_data data;
+	bt_popup_event_type_t event_type;
+	bt_request_priority_t priority;
+	int timeout;		/* Renderer may shorten desc->timeout */
+	double arrival;		/* ecore_time_get() */
+	double deadline;
+	gint64 trace[BT_TRACE_PHASE_MAX];
+	bt_record_reason_t reason;	/* First outcome wins */
+	bt_record_response_t response;
+	bt_template_origin_t origin;
+};
+
+/* PIN codes and passkeys answered, for the pairing line throughput */
+struct bt_pairing_stats {
+	unsigned int paired;
+	unsigned int provisioned;	/* Of paired, without the input view */
+	gint64 total_us;		/* Request to reply, all of paired */
+};
+
+/* Memory taken by the process with a popup shown or just closed */
+struct bt_mem_sample {
+	int objects;		/* Live Evas objects of win_main's canvas */
+	long buffer_kb;		/* Canvas output buffer */
+	long heap_kb;		/* malloc heap in use */
+	long rss_kb;
+};
+
+/* Memory accounting of one event type */
+struct bt_mem_stats {
+	unsigned int count;
+	struct bt_mem_sample show;	/* Last popup, once drawn */
+	struct bt_mem_sample teardown;	/* Last popup, when answered */
+	long rss_peak_kb;
+};
+
+/* "Accept all" answer given for the OBEX requests of one device */
+struct bt_obex_grant {
+	char device[BT_DEVICE_NAME_LENGTH_MAX];	/* "device-address" */
+	bt_popup_event_type_t event_type;
+	double expiry;
+	int covered;		/* Requests answered without a popup */
+};
+
+typedef enum {
+	BT_POPUP_LAYOUT_NONE,		/* Text only */
+	BT_POPUP_LAYOUT_ONE_BTN,	/* OK, Yes or Cancel */
+	BT_POPUP_LAYOUT_TWO_BTN,	/* Yes/No or OK/Cancel */
+	BT_POPUP_LAYOUT_THREE_BTN,	/* Yes/No and accept all */
+	BT_POPUP_LAYOUT_INPUT,		/* PIN / Passkey input view */
+	BT_POPUP_LAYOUT_MAX,
+} bt_popup_layout_t;
+
+typedef void (*bt_popup_btn_cb) (void *data, Evas_Object *obj,
+				 void *event_info);
+
+/* Pre-built widget tree which is hidden and reused between requests */
+struct bt_popup_template {
+	Evas_Object *popup;	/* Root object, conformant for input view */
+	Evas_Object *dialog;	/* elm_popup holding the buttons */
+	Evas_Object *label;
+	Evas_Object *editfield;
+	Evas_Object *entry;
+	Evas_Object *check;
+	Evas_Object *btn1;
+	Evas_Object *btn2;
+	Evas_Object *btn3;
+	bt_popup_btn_cb func;
+	int obj_count;
+	Eina_Bool prewarmed;	/* Not drawn since the prewarm idler built it */
+};
+
 struct bt_popup_appdata {
 	Evas *evas;
 	Evas_Object *win_main;
@@ -147,17 +405,65 @@ struct bt_popup_appdata {
 	Evas_Object *entry;
 	Evas_Object *editfield;
 	Evas_Object *edit_field_save_btn;
-	Evas_Object *ticker_noti;
+	Elm_Entry_Filter_Limit_Size input_limit;
+	Elm_Entry_Filter_Accept_Set input_accept;
+
+	struct bt_popup_template templates[BT_POPUP_LAYOUT_MAX];
+	int obj_created;
+	int obj_reused;
 
 	Ecore_Timer *timer;
+	Ecore_Timer *idle_timer;
+	Ecore_Idler *prepare_idler;
+	Ecore_Idler *prewarm_idler;	/* Builds the missing templates */
+	Ecore_Job *submit_job;		/* Passkey auto-submit */
+	Ecore_Job *next_job;		/* Shows the next queued request */
 	Ecore_Event_Handler *event_handle;
 
+	DBusGConnection *conn;
 	DBusGProxy *agent_proxy;
 	DBusGProxy *obex_proxy;
-	E_DBus_Connection *EDBusHandle;
+	DBusGProxy *bus_proxy;	/* NameOwnerChanged of the agent */
+
+	/* Created on first use, see __bluetooth_prepare_resources */
+	Eina_Bool name_requested;
+	Eina_Bool imf_initialized;
+	Ecore_IMF_Context *imf_context;	/* Of the input view entry */
 
 	int changed_mode;
 	bt_popup_event_type_t event_type;
+
+	/* Request shown now and the ones waiting behind it */
+	struct bt_popup_request *request;
+	struct bt_popup_request *queue[BT_REQUEST_QUEUE_MAX];
+	int queue_len;
+
+	struct bt_reply_stats reply_stats[BT_REPLY_METHOD_MAX];
+	int pending_replies;
+
+	struct bt_obex_grant grants[BT_OBEX_GRANT_MAX];
+	Ecore_Timer *grant_timer;
+
+	struct bt_policy *policy;	/* Loaded with the first request */
+	Eina_Bool policy_loaded;
+
+	struct bt_provision_store *provision;
+	Eina_Bool provision_loaded;
+	struct bt_pairing_stats pairing_stats;
+
+	long rss_peak;		/* KB, highest RSS after a closed popup */
+	struct bt_mem_stats mem_stats[BT_EVENT_DESC_MAX];
+	Eina_Bool stats_registered;
+
+	/* Process phases of the launch trace, see bt_trace_phase_t */
+	gint64 launch_trace[BT_TRACE_RESET];
+	Eina_Bool launch_traced;
+	Eina_Bool frame_pending;
+
+	/* Resident mode: hide and reuse win_main instead of exiting */
+	Eina_Bool resident;
+	Eina_Bool compact;	/* win_main sized to the popup, not alpha */
+	Eina_Bool syspopup_created;
 };
 
 #endif				/* __DEF_BT_SYSPOPUP_H_ */